@@ -0,0 +1,233 @@
+/*
+ * arena.c
+ *
+ * Bump allocator for all of the memory a scan needs
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "arena.h"
+
+/* Big enough to hold a whole device with all of its interfaces */
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+/* the biggest things we store are pointers and 64bit values */
+#define ARENA_ALIGN		8
+
+static struct arena_chunk *new_arena_chunk(struct arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+
+	if (size < ARENA_CHUNK_SIZE)
+		size = ARENA_CHUNK_SIZE;
+	chunk = malloc(sizeof(*chunk) + size);
+	if (chunk == NULL)
+		exit(1);
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->nchunks++;
+	arena->allocated += size;
+	if (arena->allocated > arena->high_water)
+		arena->high_water = arena->allocated;
+	return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena->chunks;
+	size_t offset = 0;
+	void *data;
+
+	if (chunk != NULL)
+		offset = (chunk->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (chunk == NULL || offset > chunk->size ||
+	    chunk->size - offset < size) {
+		chunk = new_arena_chunk(arena, size);
+		offset = 0;
+	}
+	data = &chunk->data[offset];
+	chunk->used = offset + size;
+	arena->used += size;
+	memset(data, 0, size);
+	return data;
+}
+
+char *arena_strdup(struct arena *arena, const char *string)
+{
+	size_t len = strlen(string) + 1;
+	struct arena_chunk *chunk = arena->chunks;
+	char *data;
+
+	/* strings don't need any alignment, so pack them in tight */
+	if (chunk == NULL || chunk->size - chunk->used < len)
+		chunk = new_arena_chunk(arena, len);
+	data = (char *)&chunk->data[chunk->used];
+	chunk->used += len;
+	arena->used += len;
+	memcpy(data, string, len);
+	return data;
+}
+
+/*
+ * Take over all of the memory of @from, so that it is released along with
+ * @arena.  The chunk we are currently allocating out of stays at the front.
+ */
+void arena_adopt(struct arena *arena, struct arena *from)
+{
+	struct arena_chunk *last;
+
+	if (from->chunks == NULL)
+		return;
+	for (last = from->chunks; last->next != NULL; last = last->next)
+		;
+	if (arena->chunks == NULL) {
+		arena->chunks = from->chunks;
+	} else {
+		last->next = arena->chunks->next;
+		arena->chunks->next = from->chunks;
+	}
+	arena->used += from->used;
+	arena->allocated += from->allocated;
+	arena->nchunks += from->nchunks;
+	if (arena->allocated > arena->high_water)
+		arena->high_water = arena->allocated;
+
+	from->chunks = NULL;
+	from->used = 0;
+	from->allocated = 0;
+	from->nchunks = 0;
+}
+
+void arena_release(struct arena *arena)
+{
+	struct arena_chunk *chunk;
+	struct arena_chunk *next;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	arena->chunks = NULL;
+	arena->used = 0;
+	arena->allocated = 0;
+	arena->nchunks = 0;
+}
+
+/*
+ * Everything that is not built for a snapshot of its own comes out of
+ * scan_arena.  robust_malloc() allocates out of whichever arena the thread
+ * has been told to use.
+ */
+struct arena scan_arena;
+static __thread struct arena *thread_arena = &scan_arena;
+
+void *robust_malloc(size_t size)
+{
+	count_stat(STAT_ALLOCS, 1);
+	count_stat(STAT_ALLOC_BYTES, size);
+	return arena_alloc(thread_arena, size);
+}
+
+char *robust_strdup(const char *string)
+{
+	count_stat(STAT_ALLOCS, 1);
+	count_stat(STAT_ALLOC_BYTES, strlen(string) + 1);
+	return arena_strdup(thread_arena, string);
+}
+
+/*
+ * The same few strings turn up on device after device: "usb", "hub" and
+ * "usbhid" as drivers, the same manufacturer and product on every port of
+ * a rack full of the same hubs.  robust_intern() keeps just one copy of
+ * each, so they can also be compared by pointer.  The copies live in an
+ * arena of their own that is never released, as any snapshot or hotplugged
+ * device may be pointing at them.  Don't write to them.
+ *
+ * The table is shared by all threads, so each thread remembers the last
+ * strings it looked up, and only takes the lock for the ones it has not.
+ */
+#define INTERN_HASH_SIZE	4096
+#define INTERN_CACHE_SIZE	64
+
+struct interned_string {
+	struct interned_string *next;
+	u32 hash;
+	char string[];
+};
+
+struct arena intern_arena;
+unsigned int interned_strings;
+static struct interned_string *intern_hash[INTERN_HASH_SIZE];
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct interned_string *intern_cache[INTERN_CACHE_SIZE];
+
+/* FNV-1a */
+static u32 hash_string(const char *string, size_t *len)
+{
+	const unsigned char *p = (const unsigned char *)string;
+	u32 hash = 2166136261U;
+
+	while (*p) {
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+	*len = p - (const unsigned char *)string;
+	return hash;
+}
+
+char *robust_intern(const char *string)
+{
+	struct interned_string **cached;
+	struct interned_string *interned;
+	size_t len;
+	u32 hash;
+
+	hash = hash_string(string, &len);
+	cached = &intern_cache[hash % INTERN_CACHE_SIZE];
+	if (*cached && (*cached)->hash == hash &&
+	    strcmp((*cached)->string, string) == 0)
+		return (*cached)->string;
+
+	pthread_mutex_lock(&intern_lock);
+	for (interned = intern_hash[hash % INTERN_HASH_SIZE]; interned;
+	     interned = interned->next)
+		if (interned->hash == hash && strcmp(interned->string, string) == 0)
+			break;
+	if (interned == NULL) {
+		count_stat(STAT_ALLOCS, 1);
+		count_stat(STAT_ALLOC_BYTES, len + 1);
+		interned = arena_alloc(&intern_arena, sizeof(*interned) + len + 1);
+		interned->hash = hash;
+		memcpy(interned->string, string, len + 1);
+		interned->next = intern_hash[hash % INTERN_HASH_SIZE];
+		intern_hash[hash % INTERN_HASH_SIZE] = interned;
+		interned_strings++;
+	}
+	pthread_mutex_unlock(&intern_lock);
+
+	*cached = interned;
+	return interned->string;
+}
+
+/* Allocate out of @arena from now on, returns the arena used until now */
+struct arena *use_arena(struct arena *arena)
+{
+	struct arena *old = thread_arena;
+
+	thread_arena = arena;
+	return old;
+}
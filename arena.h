@@ -0,0 +1,28 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+/*
+ * Simple bump allocator.  Everything we build during a scan lives until the
+ * scan is thrown away, so there is no point in freeing things one at a time.
+ */
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	unsigned char data[];
+};
+
+struct arena {
+	struct arena_chunk *chunks;
+	size_t used;		/* bytes handed out */
+	size_t allocated;	/* bytes of chunk memory malloc()ed */
+	unsigned int nchunks;
+	size_t high_water;	/* biggest 'allocated' seen, survives release */
+};
+
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strdup(struct arena *arena, const char *string);
+void arena_adopt(struct arena *arena, struct arena *from);
+void arena_release(struct arena *arena);
+
+#endif	/* define _ARENA_H */
@@ -0,0 +1,346 @@
+/*
+ * attr.c
+ *
+ * Read sysfs attributes into struct usb_device, usb_interface and
+ * usb_endpoint fields, a batch at a time.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <ctype.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include "uring.h"
+#endif
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+/*
+ * Attributes are queued up with queue_dev_attrs() while a device and its
+ * interfaces are being built, and read in one go by flush_dev_attrs().  With
+ * io_uring that is one system call for all of the opens, one for the reads
+ * and one for the closes, instead of three for every single attribute.
+ */
+#define ATTR_BATCH_SIZE		64
+#define ATTR_VALUE_SIZE		512
+
+struct attr_request {
+	struct sysfs_dev *dev;
+	void *object;
+	const struct dev_attr *attr;
+	char path[48];
+	int fd;
+	int len;
+	char value[ATTR_VALUE_SIZE];
+};
+
+struct attr_batch {
+	unsigned int count;
+	struct attr_request requests[ATTR_BATCH_SIZE];
+};
+
+enum io_engine io_engine = IO_AUTO;
+
+static __thread struct attr_batch *batch;
+
+#ifdef HAVE_IO_URING
+static __thread struct uring ring;
+static __thread int have_ring;
+#endif
+
+void attr_thread_init(void)
+{
+	batch = calloc(1, sizeof(*batch));
+	if (batch == NULL)
+		exit(1);
+#ifdef HAVE_IO_URING
+	/* io_uring only works on real directory fds, not through libudev */
+	if (io_engine != IO_SYNC && !use_libudev)
+		have_ring = (uring_init(&ring, ATTR_BATCH_SIZE) == 0);
+	if (io_engine == IO_URING && !have_ring)
+		fprintf(stderr, "io_uring %s, using plain reads\n",
+			use_libudev ? "needs --backend=sysfs" : "not available");
+#endif
+}
+
+void attr_thread_exit(void)
+{
+#ifdef HAVE_IO_URING
+	if (have_ring)
+		uring_exit(&ring);
+	have_ring = 0;
+#endif
+	free(batch);
+	batch = NULL;
+}
+
+/* "1.5", "12", "480", "5000", ... Mbit/s turned into kbit/s */
+static unsigned long parse_speed(const char *value)
+{
+	unsigned long speed;
+	char *end;
+
+	speed = strtoul(value, &end, 10) * 1000;
+	if (*end == '.' && isdigit(end[1]))
+		speed += (end[1] - '0') * 100;
+	return speed;
+}
+
+/* " 2.00" as shown by the "version" file back into a bcd value */
+static unsigned long parse_bcd(const char *value)
+{
+	unsigned long bcd;
+	char *end;
+
+	bcd = strtoul(value, &end, 16) << 8;
+	if (*end == '.')
+		bcd |= strtoul(end + 1, NULL, 16) & 0xff;
+	return bcd;
+}
+
+/*
+ * Numeric attributes are parsed once here when the device is loaded, so
+ * nothing after that needs to care about the sysfs string format.  A missing
+ * attribute leaves the field at 0 (or NULL for strings).
+ */
+static void store_dev_attr(void *object, const struct dev_attr *attr,
+			   const char *value)
+{
+	unsigned char *field = (unsigned char *)object + attr->offset;
+	unsigned long number;
+
+	if (value == NULL)
+		return;
+
+	switch (attr->type) {
+	case ATTR_STRING:
+		*(char **)field = robust_strdup(value);
+		return;
+	case ATTR_INTERN:
+		*(char **)field = robust_intern(value);
+		return;
+	case ATTR_DEC:
+		number = strtoul(value, NULL, 10);
+		break;
+	case ATTR_HEX:
+		number = strtoul(value, NULL, 16);
+		break;
+	case ATTR_SPEED:
+		number = parse_speed(value);
+		break;
+	case ATTR_BCD:
+		number = parse_bcd(value);
+		break;
+	default:
+		return;
+	}
+
+	switch (attr->size) {
+	case 1:
+		*(u8 *)field = number;
+		break;
+	case 2:
+		*(u16 *)field = number;
+		break;
+	case 4:
+		*(u32 *)field = number;
+		break;
+	}
+}
+
+static void flush_dev_attrs_sync(void)
+{
+	struct attr_request *request;
+	const char *value;
+	unsigned int i;
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		value = read_dev_attr(request->dev, request->path,
+				      request->value, sizeof(request->value));
+		store_dev_attr(request->object, request->attr, value);
+	}
+}
+
+#ifdef HAVE_IO_URING
+static void attr_opened(u64 user_data, int res, void *data)
+{
+	(void)data;
+	count_stat(STAT_OPENS, 1);
+	batch->requests[user_data].fd = res;
+}
+
+static void attr_read(u64 user_data, int res, void *data)
+{
+	(void)data;
+	count_stat(STAT_READS, 1);
+	if (res > 0)
+		count_stat(STAT_READ_BYTES, res);
+	batch->requests[user_data].len = res;
+}
+
+static void attr_closed(u64 user_data, int res, void *data)
+{
+	(void)res;
+	(void)data;
+	batch->requests[user_data].fd = -1;
+}
+
+/* the ring gave up on us, close whatever it opened that is still open */
+static void close_attr_fds(void)
+{
+	struct attr_request *request;
+	unsigned int i;
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		if (request->fd >= 0)
+			close(request->fd);
+		request->fd = -1;
+	}
+}
+
+static int flush_dev_attrs_uring(void)
+{
+	struct attr_request *request;
+	struct io_uring_sqe *sqe;
+	const char *value;
+	unsigned int i;
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		sqe = uring_get_sqe(&ring);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = request->dev->dirfd;
+		sqe->addr = (unsigned long)request->path;
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		sqe->user_data = i;
+	}
+	if (uring_submit_and_wait(&ring, attr_opened, NULL)) {
+		close_attr_fds();
+		return -1;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		request->len = -1;
+		if (request->fd < 0)
+			continue;
+		sqe = uring_get_sqe(&ring);
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = request->fd;
+		sqe->addr = (unsigned long)request->value;
+		sqe->len = sizeof(request->value) - 1;
+		sqe->off = 0;
+		sqe->user_data = i;
+	}
+	if (uring_submit_and_wait(&ring, attr_read, NULL)) {
+		close_attr_fds();
+		return -1;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		if (request->fd < 0)
+			continue;
+		sqe = uring_get_sqe(&ring);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = request->fd;
+		sqe->user_data = i;
+	}
+	if (uring_submit_and_wait(&ring, attr_closed, NULL)) {
+		close_attr_fds();
+		return -1;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		request = &batch->requests[i];
+		value = NULL;
+		if (request->len >= 0) {
+			int len = request->len;
+
+			while (len > 0 && request->value[len - 1] == '\n')
+				len--;
+			request->value[len] = '\0';
+			value = request->value;
+		}
+		store_dev_attr(request->object, request->attr, value);
+	}
+	return 0;
+}
+#endif
+
+void flush_dev_attrs(void)
+{
+	unsigned long start = stat_timer_begin();
+
+#ifdef HAVE_IO_URING
+	if (have_ring && batch->count) {
+		if (flush_dev_attrs_uring() == 0) {
+			batch->count = 0;
+			stat_timer_end(TIMER_ATTRIBUTES, start);
+			return;
+		}
+		/* something went badly wrong, don't try that again */
+		uring_exit(&ring);
+		have_ring = 0;
+	}
+#endif
+	flush_dev_attrs_sync();
+	batch->count = 0;
+	stat_timer_end(TIMER_ATTRIBUTES, start);
+}
+
+/*
+ * Queue up reading the @attrs of @dev whose bits are set in @mask into
+ * @object.  @dir is the subdirectory of @dev they live in (an endpoint), or
+ * NULL.  The values show up in @object by the time flush_dev_attrs()
+ * returns, and @dev has to stay open until then.
+ */
+void queue_dev_attr_set(struct sysfs_dev *dev, const char *dir, void *object,
+			const struct dev_attr *attrs, unsigned int count,
+			u32 mask)
+{
+	struct attr_request *request;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!(mask & (1U << i)))
+			continue;
+		if (batch->count == ATTR_BATCH_SIZE)
+			flush_dev_attrs();
+		request = &batch->requests[batch->count++];
+		request->dev = dev;
+		request->object = object;
+		request->attr = &attrs[i];
+		request->fd = -1;
+		if (dir)
+			snprintf(request->path, sizeof(request->path), "%s/%s",
+				 dir, attrs[i].name);
+		else
+			snprintf(request->path, sizeof(request->path), "%s",
+				 attrs[i].name);
+	}
+}
+
+void queue_dev_attrs(struct sysfs_dev *dev, const char *dir, void *object,
+		     const struct dev_attr *attrs, unsigned int count)
+{
+	queue_dev_attr_set(dev, dir, object, attrs, count, ~0U);
+}
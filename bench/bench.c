@@ -0,0 +1,167 @@
+/*
+ * bench.c
+ *
+ * Run a command a few times and say how long it took, how many system calls
+ * it made and how much memory it needed at most.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define RUNS	5
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* stdout goes nowhere, it's not what is being measured */
+static void quiet_stdout(void)
+{
+	int fd = open("/dev/null", O_WRONLY);
+
+	if (fd != -1) {
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+	}
+}
+
+/* one plain run, returns the wall time, and the peak RSS in @maxrss (KiB) */
+static double run(char *argv[], long *maxrss, int keep_stderr)
+{
+	struct rusage usage;
+	double start;
+	int status;
+	pid_t pid;
+
+	start = now();
+	pid = fork();
+	if (pid == 0) {
+		quiet_stdout();
+		if (!keep_stderr)
+			dup2(STDOUT_FILENO, STDERR_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	if (pid == -1 || wait4(pid, &status, 0, &usage) != pid) {
+		fprintf(stderr, "can't run %s\n", argv[0]);
+		exit(1);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s failed\n", argv[0]);
+		exit(1);
+	}
+	*maxrss = usage.ru_maxrss;
+	return now() - start;
+}
+
+/*
+ * Count system calls with ptrace, threads included.  Every system call
+ * stops the tracee twice, on the way in and on the way out, so only every
+ * other stop of each thread is counted.
+ */
+static long count_syscalls(char *argv[])
+{
+	unsigned char in_syscall[65536];
+	long count = 0;
+	int status;
+	pid_t pid;
+	pid_t tid;
+	int sig;
+
+	memset(in_syscall, 0, sizeof(in_syscall));
+	pid = fork();
+	if (pid == 0) {
+		quiet_stdout();
+		dup2(STDOUT_FILENO, STDERR_FILENO);
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) != pid)
+		return -1;
+	ptrace(PTRACE_SETOPTIONS, pid, NULL,
+	       (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE |
+			      PTRACE_O_TRACEEXEC));
+	ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+
+	while ((tid = waitpid(-1, &status, __WALL)) > 0) {
+		if (!WIFSTOPPED(status))
+			continue;
+		sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+			if (!in_syscall[tid & 0xffff])
+				count++;
+			in_syscall[tid & 0xffff] ^= 1;
+		} else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+			sig = WSTOPSIG(status);
+		}
+		ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)sig);
+	}
+	return count;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * The wall time is the median of RUNS runs.  Then there is one more run that
+ * gets to print to stderr, so whatever lsusb --stats says about where the
+ * time went shows up under our line.
+ */
+int main(int argc, char *argv[])
+{
+	double times[RUNS];
+	long maxrss = 0;
+	long rss;
+	long syscalls;
+	int i;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s LABEL COMMAND [ARGS...]\n", argv[0]);
+		return 1;
+	}
+
+	/* warm up the dentry and inode caches first */
+	run(argv + 2, &rss, 0);
+	for (i = 0; i < RUNS; i++) {
+		times[i] = run(argv + 2, &rss, 0);
+		if (rss > maxrss)
+			maxrss = rss;
+	}
+	qsort(times, RUNS, sizeof(times[0]), compare_doubles);
+	syscalls = count_syscalls(argv + 2);
+
+	printf("%-14s wall %9.3f ms  syscalls %8ld  peak rss %7ld KiB\n",
+	       argv[1], times[RUNS / 2] * 1000, syscalls, maxrss);
+	fflush(stdout);
+	run(argv + 2, &rss, 1);
+	return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * descbench.c
+ *
+ * How fast do the "descriptors" files parse?  Runs the parser from raw.c
+ * over blobs in memory, no sysfs involved, and says how many descriptors
+ * and how many bytes it gets through a second.  The blobs are a few built
+ * in ones and any descriptors files given on the command line, and then
+ * the same again, mangled, to see that the bad ones cost no more than the
+ * good ones.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "arena.h"
+#include "descriptors.h"
+
+#define MUTANTS		64	/* mangled copies of each blob */
+#define SECONDS		1.0	/* how long to keep at each set */
+
+struct blob {
+	unsigned char *data;
+	size_t size;
+	unsigned int descriptors;
+};
+
+struct blob_set {
+	struct blob *blobs;
+	unsigned int count;
+	unsigned int allocated;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the same walk the parser does, so only what it looks at is counted */
+static unsigned int count_descriptors(const unsigned char *data, size_t size)
+{
+	unsigned int count = 0;
+	size_t offset = 0;
+
+	while (size - offset >= 2 && data[offset] >= 2 &&
+	       data[offset] <= size - offset) {
+		offset += data[offset];
+		count++;
+	}
+	return count;
+}
+
+static void add_blob(struct blob_set *set, const unsigned char *data, size_t size)
+{
+	struct blob *blob;
+
+	if (set->count == set->allocated) {
+		set->allocated = set->allocated ? set->allocated * 2 : 64;
+		set->blobs = realloc(set->blobs, set->allocated * sizeof(*blob));
+		if (set->blobs == NULL)
+			exit(1);
+	}
+	blob = &set->blobs[set->count++];
+	blob->data = malloc(size ? size : 1);
+	if (blob->data == NULL)
+		exit(1);
+	memcpy(blob->data, data, size);
+	blob->size = size;
+	blob->descriptors = count_descriptors(data, size);
+}
+
+static void add_file(struct blob_set *set, const char *filename)
+{
+	unsigned char data[65536];
+	ssize_t retval;
+	size_t size = 0;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "can't open %s\n", filename);
+		exit(1);
+	}
+	while (size < sizeof(data)) {
+		retval = read(fd, data + size, sizeof(data) - size);
+		if (retval <= 0)
+			break;
+		size += retval;
+	}
+	close(fd);
+	add_blob(set, data, size);
+}
+
+/* parse everything in @set over and over, for about SECONDS */
+static void run(const char *name, const struct blob_set *set)
+{
+	struct usb_device usb_device;
+	struct arena arena = { 0 };
+	struct arena *old_arena;
+	unsigned long descriptors = 0;
+	unsigned long bytes = 0;
+	unsigned long passes = 0;
+	double start, elapsed;
+	unsigned int i;
+
+	old_arena = use_arena(&arena);
+	start = now();
+	do {
+		for (i = 0; i < set->count; i++) {
+			memset(&usb_device, 0, sizeof(usb_device));
+			INIT_LIST_HEAD(&usb_device.interfaces);
+			INIT_LIST_HEAD(&usb_device.configs);
+			parse_raw_usb_descriptors(&usb_device, set->blobs[i].data,
+						  set->blobs[i].size);
+			descriptors += set->blobs[i].descriptors;
+			bytes += set->blobs[i].size;
+		}
+		/* a scan's worth of devices, then start over */
+		arena_release(&arena);
+		passes++;
+		elapsed = now() - start;
+	} while (elapsed < SECONDS);
+	use_arena(old_arena);
+
+	printf("%-10s %6u blobs  %8.2f M descriptors/s  %8.1f MB/s  %6.0f ns/blob\n",
+	       name, set->count, descriptors / elapsed / 1e6,
+	       bytes / elapsed / 1e6, elapsed * 1e9 / (passes * set->count));
+}
+
+int main(int argc, char *argv[])
+{
+	struct blob_set recorded = { 0 };
+	struct blob_set mutated = { 0 };
+	unsigned char mutant[65536 + MUTATE_GROWTH];
+	unsigned int seed = 1;
+	unsigned int i, j;
+	size_t size;
+
+	for (i = 0; i < ARRAY_SIZE(builtin_descriptors); i++)
+		add_blob(&recorded, builtin_descriptors[i].data,
+			 builtin_descriptors[i].size);
+	for (i = 1; i < (unsigned int)argc; i++)
+		add_file(&recorded, argv[i]);
+
+	for (i = 0; i < recorded.count; i++) {
+		for (j = 0; j < MUTANTS; j++) {
+			size = mutate_descriptors(mutant, recorded.blobs[i].data,
+						  recorded.blobs[i].size, &seed);
+			add_blob(&mutated, mutant, size);
+		}
+	}
+
+	/* the device descriptor is only looked at in descriptor mode */
+	descriptor_mode = 1;
+	run("recorded", &recorded);
+	run("mutated", &mutated);
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * descriptors.h
+ *
+ * A few "descriptors" files the way sysfs has them, to start the
+ * descriptor benchmark and the fuzzer off with.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#ifndef _BENCH_DESCRIPTORS_H
+#define _BENCH_DESCRIPTORS_H
+
+/* low speed mouse: device, config, interface, HID, endpoint */
+static const unsigned char mouse_descriptors[] = {
+	0x12, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x08, 0x6d, 0x04,
+	0x2b, 0xc5, 0x10, 0x12, 0x01, 0x02, 0x00, 0x01,
+	0x09, 0x02, 0x22, 0x00, 0x01, 0x01, 0x00, 0xa0, 0x32,
+	0x09, 0x04, 0x00, 0x00, 0x01, 0x03, 0x01, 0x02, 0x00,
+	0x09, 0x21, 0x11, 0x01, 0x00, 0x01, 0x22, 0x4a, 0x00,
+	0x07, 0x05, 0x81, 0x03, 0x08, 0x00, 0x0a,
+};
+
+/* high speed hub, with a device qualifier */
+static const unsigned char hub_descriptors[] = {
+	0x12, 0x01, 0x00, 0x02, 0x09, 0x00, 0x01, 0x40, 0x6b, 0x1d,
+	0x02, 0x00, 0x06, 0x05, 0x03, 0x02, 0x01, 0x01,
+	0x09, 0x02, 0x19, 0x00, 0x01, 0x01, 0x00, 0xe0, 0x00,
+	0x09, 0x04, 0x00, 0x00, 0x01, 0x09, 0x00, 0x00, 0x00,
+	0x07, 0x05, 0x81, 0x03, 0x04, 0x00, 0x0c,
+	0x0a, 0x06, 0x00, 0x02, 0x09, 0x00, 0x00, 0x40, 0x01, 0x00,
+};
+
+/*
+ * Webcam with a microphone: an interface association, class specific
+ * video descriptors, alternate settings and an isochronous endpoint.
+ */
+static const unsigned char webcam_descriptors[] = {
+	0x12, 0x01, 0x00, 0x02, 0xef, 0x02, 0x01, 0x40, 0x6d, 0x04,
+	0x25, 0x08, 0x10, 0x00, 0x00, 0x02, 0x01, 0x01,
+	0x09, 0x02, 0x6b, 0x00, 0x03, 0x01, 0x00, 0x80, 0xfa,
+	0x08, 0x0b, 0x00, 0x02, 0x0e, 0x03, 0x00, 0x00,
+	0x09, 0x04, 0x00, 0x00, 0x01, 0x0e, 0x01, 0x00, 0x00,
+	0x0d, 0x24, 0x01, 0x00, 0x01, 0x4d, 0x00, 0x80, 0xc3, 0xc9,
+	0x01, 0x01, 0x01,
+	0x07, 0x05, 0x83, 0x03, 0x10, 0x00, 0x08,
+	0x05, 0x25, 0x03, 0x10, 0x00,
+	0x09, 0x04, 0x01, 0x00, 0x00, 0x0e, 0x02, 0x00, 0x00,
+	0x09, 0x04, 0x01, 0x01, 0x01, 0x0e, 0x02, 0x00, 0x00,
+	0x07, 0x05, 0x81, 0x05, 0x80, 0x13, 0x01,
+	0x09, 0x04, 0x02, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00,
+	0x09, 0x24, 0x01, 0x00, 0x01, 0x1e, 0x00, 0x01, 0x03,
+};
+
+static const struct {
+	const char *name;
+	const unsigned char *data;
+	size_t size;
+} builtin_descriptors[] = {
+	{ "mouse",	mouse_descriptors,	sizeof(mouse_descriptors) },
+	{ "hub",	hub_descriptors,	sizeof(hub_descriptors) },
+	{ "webcam",	webcam_descriptors,	sizeof(webcam_descriptors) },
+};
+
+/*
+ * The kind of damage a broken (or hostile) device does: bytes changed,
+ * lengths that lie, descriptors cut short or repeated.  @to needs room for
+ * @size + MUTATE_GROWTH bytes, the new size is returned.
+ */
+#define MUTATE_GROWTH	64
+
+static unsigned int mutate_random(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+static size_t mutate_descriptors(unsigned char *to, const unsigned char *from,
+				 size_t size, unsigned int *seed)
+{
+	unsigned int changes = 1 + mutate_random(seed) % 4;
+	size_t limit = size + MUTATE_GROWTH;
+	size_t offset;
+	size_t length;
+
+	memcpy(to, from, size);
+	while (changes--) {
+		if (size == 0)
+			break;
+		offset = mutate_random(seed) % size;
+		switch (mutate_random(seed) % 5) {
+		case 0:
+			to[offset] ^= 1 << (mutate_random(seed) % 8);
+			break;
+		case 1:
+			to[offset] = mutate_random(seed);
+			break;
+		case 2:
+			/* a bLength of 0, 1, just too short or far too long */
+			to[offset] = "\0\1\2\6\10\x11\xff"[mutate_random(seed) % 7];
+			break;
+		case 3:
+			size = offset;
+			break;
+		case 4:
+			length = mutate_random(seed) % MUTATE_GROWTH;
+			if (length > size - offset)
+				length = size - offset;
+			if (length > limit - size)
+				length = limit - size;
+			memmove(to + offset + length, to + offset, size - offset);
+			size += length;
+			break;
+		}
+	}
+	return size;
+}
+
+#endif	/* define _BENCH_DESCRIPTORS_H */
@@ -0,0 +1,163 @@
+/*
+ * fuzz-descriptors.c
+ *
+ * Throw anything at all at the descriptor parser, and at the decoder for
+ * lsusb -v.  The "descriptors" file is whatever the device sent, so they
+ * must never read past the end of it, no matter what the lengths in it say.
+ *
+ * Built with clang -fsanitize=fuzzer,address ("make fuzz") this is a
+ * libFuzzer target, start it with a directory to keep its corpus in.
+ * Built with -DFUZZ_STANDALONE instead ("make fuzz-standalone", any
+ * compiler with -fsanitize=address will do) it has its own main():
+ *
+ *	fuzz-descriptors FILE...	parse each file, to replay a crash
+ *	fuzz-descriptors < FILE		parse stdin, for afl-fuzz
+ *	fuzz-descriptors -n COUNT	parse COUNT mangled built in blobs
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "arena.h"
+#include "descriptors.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/* what -v prints is of no interest, only that it gets printed */
+static struct outbuf *decode_out(void)
+{
+	static struct outbuf out;
+	static int fd = -1;
+
+	if (fd == -1) {
+		fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		out_init(&out, fd);
+	}
+	out.error = 0;
+	return &out;
+}
+
+/*
+ * The input goes into a buffer of exactly its own size, so that the
+ * sanitizer notices even a one byte overrun.  Both modes, as descriptor
+ * mode is the only one that reads the device descriptor.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static struct arena arena;
+	struct outbuf *out = decode_out();
+	struct usb_device usb_device;
+	struct arena *old_arena;
+	unsigned char *copy;
+	int mode;
+
+	copy = malloc(size ? size : 1);
+	if (copy == NULL)
+		exit(1);
+	memcpy(copy, data, size);
+
+	old_arena = use_arena(&arena);
+	for (mode = 0; mode <= 1; mode++) {
+		descriptor_mode = mode;
+		memset(&usb_device, 0, sizeof(usb_device));
+		INIT_LIST_HEAD(&usb_device.interfaces);
+		INIT_LIST_HEAD(&usb_device.configs);
+		parse_raw_usb_descriptors(&usb_device, copy, size);
+	}
+	arena_release(&arena);
+	use_arena(old_arena);
+
+	/* the unit for MaxPower is all that the speed changes */
+	decode_usb_descriptors(out, copy, size, size & 1 ? 5000000 : 480000);
+	out_flush(out);
+
+	free(copy);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+static void parse_fd(int fd, const char *name)
+{
+	unsigned char data[65536];
+	ssize_t retval;
+	size_t size = 0;
+
+	while (size < sizeof(data)) {
+		retval = read(fd, data + size, sizeof(data) - size);
+		if (retval < 0 && errno == EINTR)
+			continue;
+		if (retval < 0) {
+			fprintf(stderr, "can't read %s\n", name);
+			exit(1);
+		}
+		if (retval == 0)
+			break;
+		size += retval;
+	}
+	LLVMFuzzerTestOneInput(data, size);
+}
+
+/* every built in blob, then @count mangled ones */
+static void parse_mutants(unsigned long count)
+{
+	unsigned char mutant[256 + MUTATE_GROWTH];
+	unsigned int seed = 1;
+	unsigned long i;
+	unsigned int n;
+	size_t size;
+
+	for (n = 0; n < ARRAY_SIZE(builtin_descriptors); n++)
+		LLVMFuzzerTestOneInput(builtin_descriptors[n].data,
+				       builtin_descriptors[n].size);
+	for (i = 0; i < count; i++) {
+		n = i % ARRAY_SIZE(builtin_descriptors);
+		size = mutate_descriptors(mutant, builtin_descriptors[n].data,
+					  builtin_descriptors[n].size, &seed);
+		LLVMFuzzerTestOneInput(mutant, size);
+	}
+	printf("%lu blobs parsed\n", count + ARRAY_SIZE(builtin_descriptors));
+}
+
+int main(int argc, char *argv[])
+{
+	int fd;
+	int i;
+
+	if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+		parse_mutants(strtoul(argv[2], NULL, 0));
+		return 0;
+	}
+	if (argc == 1) {
+		parse_fd(STDIN_FILENO, "stdin");
+		return 0;
+	}
+	for (i = 1; i < argc; i++) {
+		fd = open(argv[i], O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, "can't open %s\n", argv[i]);
+			exit(1);
+		}
+		parse_fd(fd, argv[i]);
+		close(fd);
+	}
+	return 0;
+}
+
+#endif	/* FUZZ_STANDALONE */
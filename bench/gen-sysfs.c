@@ -0,0 +1,483 @@
+/*
+ * gen-sysfs.c
+ *
+ * Write out a fake, but realistic, USB sysfs tree to point lsusb --sysroot
+ * at: any number of buses, hubs nested right down to the 7 tier limit,
+ * composite devices, and descriptors files that parse.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/*
+ * A bus can only have 127 devices on it, the root hub being one of them,
+ * and a device is at most 7 tiers down: the root hub is tier 1, then up to
+ * 5 hubs, and whatever is plugged into the last one.
+ */
+#define DEVICES_PER_BUS		120
+#define MAX_TIER		7
+#define HUB_PORTS		7
+
+static const char *root;
+static unsigned int seed = 1;
+
+static unsigned int random_number(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+static void make_dirs(const char *path)
+{
+	char temp[PATH_MAX];
+	char *slash;
+
+	snprintf(temp, sizeof(temp), "%s", path);
+	for (slash = strchr(temp + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		if (mkdir(temp, 0755) && errno != EEXIST)
+			goto error;
+		*slash = '/';
+	}
+	if (mkdir(temp, 0755) && errno != EEXIST)
+		goto error;
+	return;
+error:
+	fprintf(stderr, "can't create %s: %s\n", temp, strerror(errno));
+	exit(1);
+}
+
+static void write_file(const char *dir, const char *name, const void *data, size_t size)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1 || write(fd, data, size) != (ssize_t)size) {
+		fprintf(stderr, "can't write %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+}
+
+static void attr(const char *dir, const char *name, const char *format, ...)
+{
+	char value[256];
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = vsnprintf(value, sizeof(value) - 1, format, args);
+	va_end(args);
+	value[len++] = '\n';
+	write_file(dir, name, value, len);
+}
+
+/* a symlink from @dir/@name to the absolute (inside the tree) @target */
+static void link_to(const char *dir, const char *name, const char *target)
+{
+	char path[PATH_MAX];
+	char relative[PATH_MAX];
+	const char *p;
+	int len = 0;
+
+	/* one "../" for every directory @dir is below the root */
+	for (p = dir + strlen(root); *p; p++)
+		if (*p == '/')
+			len += snprintf(relative + len, sizeof(relative) - len, "../");
+	snprintf(relative + len, sizeof(relative) - len, "%s", target);
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if (symlink(relative, path)) {
+		fprintf(stderr, "can't link %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+}
+
+/* The kinds of things that get plugged in */
+struct fake_interface {
+	unsigned char class;
+	unsigned char subclass;
+	unsigned char protocol;
+	const char *driver;
+	unsigned char endpoints[3];	/* addresses, 0 ends the list */
+	unsigned char attributes[3];
+};
+
+struct fake_kind {
+	unsigned short idVendor;
+	unsigned short idProduct;
+	unsigned char class;
+	const char *manufacturer;
+	const char *product;
+	unsigned int ninterfaces;
+	struct fake_interface interfaces[4];
+};
+
+static const struct fake_kind hub_kind = {
+	0x05e3, 0x0610, 0x09, "GenesysLogic", "USB2.0 Hub", 1, {
+		{ 0x09, 0x00, 0x01, "hub", { 0x81 }, { 0x03 } },
+	},
+};
+
+static const struct fake_kind device_kinds[] = {
+	{ 0x046d, 0xc52b, 0x00, "Logitech", "USB Receiver", 3, {
+		{ 0x03, 0x01, 0x01, "usbhid", { 0x81 }, { 0x03 } },
+		{ 0x03, 0x01, 0x02, "usbhid", { 0x82 }, { 0x03 } },
+		{ 0x03, 0x00, 0x00, "usbhid", { 0x83 }, { 0x03 } },
+	} },
+	{ 0x0781, 0x5581, 0x00, "SanDisk", "Ultra", 1, {
+		{ 0x08, 0x06, 0x50, "usb-storage", { 0x81, 0x02 }, { 0x02, 0x02 } },
+	} },
+	{ 0x0bda, 0x8153, 0x00, "Realtek", "USB 10/100/1000 LAN", 2, {
+		{ 0x02, 0x06, 0x00, "cdc_ether", { 0x83 }, { 0x03 } },
+		{ 0x0a, 0x00, 0x00, "cdc_ether", { 0x81, 0x02 }, { 0x02, 0x02 } },
+	} },
+	{ 0x046d, 0x0825, 0xef, "Logitech", "Webcam C270", 4, {
+		{ 0x0e, 0x01, 0x00, "uvcvideo", { 0x87 }, { 0x03 } },
+		{ 0x0e, 0x02, 0x00, "uvcvideo", { 0x81 }, { 0x05 } },
+		{ 0x01, 0x01, 0x00, "snd-usb-audio", { 0 }, { 0 } },
+		{ 0x01, 0x02, 0x00, "snd-usb-audio", { 0x86 }, { 0x05 } },
+	} },
+	{ 0x1050, 0x0407, 0x00, "Yubico", "YubiKey OTP+FIDO+CCID", 3, {
+		{ 0x03, 0x01, 0x01, "usbhid", { 0x81 }, { 0x03 } },
+		{ 0x03, 0x00, 0x00, "usbhid", { 0x04, 0x84 }, { 0x03, 0x03 } },
+		{ 0x0b, 0x00, 0x00, NULL, { 0x02, 0x82, 0x83 }, { 0x02, 0x02, 0x03 } },
+	} },
+};
+
+static unsigned int endpoint_packet_size(unsigned char attributes)
+{
+	switch (attributes & 0x03) {
+	case 0x02:
+		return 512;
+	case 0x01:
+		return 1024;
+	default:
+		return 8;
+	}
+}
+
+static void make_endpoint(const char *dir, unsigned char address,
+			  unsigned char attributes, unsigned int packet_size)
+{
+	static const char * const types[] = {
+		"Control", "Isoc", "Bulk", "Interrupt",
+	};
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/ep_%02x", dir, address);
+	make_dirs(path);
+	attr(path, "bEndpointAddress", "%02x", address);
+	attr(path, "bInterval", "%02x", attributes == 0 ? 0 : 4);
+	attr(path, "bLength", "07");
+	attr(path, "bmAttributes", "%02x", attributes);
+	attr(path, "wMaxPacketSize", "%04x", packet_size);
+	attr(path, "direction", "%s", address == 0 ? "both" :
+				      (address & 0x80) ? "in" : "out");
+	attr(path, "type", "%s", types[attributes & 0x03]);
+	attr(path, "interval", "%s", attributes == 0 ? "0ms" : "1ms");
+}
+
+static size_t put16(unsigned char *p, unsigned int value)
+{
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+	return 2;
+}
+
+/* The device descriptor and the one configuration, as the kernel has them */
+static size_t make_descriptors(unsigned char *blob, const struct fake_kind *kind)
+{
+	const struct fake_interface *intf;
+	unsigned char *config;
+	size_t len = 0;
+	unsigned int i, j;
+
+	blob[len++] = 18;
+	blob[len++] = 0x01;
+	len += put16(blob + len, 0x0200);
+	blob[len++] = kind->class;
+	blob[len++] = kind->class == 0xef ? 0x02 : 0x00;
+	blob[len++] = kind->class == 0xef || kind->class == 0x09 ? 0x01 : 0x00;
+	blob[len++] = 64;
+	len += put16(blob + len, kind->idVendor);
+	len += put16(blob + len, kind->idProduct);
+	len += put16(blob + len, 0x0100);
+	blob[len++] = 1;
+	blob[len++] = 2;
+	blob[len++] = 3;
+	blob[len++] = 1;
+
+	config = blob + len;
+	blob[len++] = 9;
+	blob[len++] = 0x02;
+	len += 2;			/* wTotalLength, filled in below */
+	blob[len++] = kind->ninterfaces;
+	blob[len++] = 1;
+	blob[len++] = 0;
+	blob[len++] = 0xa0;
+	blob[len++] = 50;
+	for (i = 0; i < kind->ninterfaces; i++) {
+		intf = &kind->interfaces[i];
+		blob[len++] = 9;
+		blob[len++] = 0x04;
+		blob[len++] = i;
+		blob[len++] = 0;
+		for (j = 0; j < 3 && intf->endpoints[j]; j++)
+			;
+		blob[len++] = j;
+		blob[len++] = intf->class;
+		blob[len++] = intf->subclass;
+		blob[len++] = intf->protocol;
+		blob[len++] = 0;
+		for (j = 0; j < 3 && intf->endpoints[j]; j++) {
+			blob[len++] = 7;
+			blob[len++] = 0x05;
+			blob[len++] = intf->endpoints[j];
+			blob[len++] = intf->attributes[j];
+			len += put16(blob + len, endpoint_packet_size(intf->attributes[j]));
+			blob[len++] = intf->attributes[j] == 0x02 ? 0 : 4;
+		}
+	}
+	put16(config + 2, blob + len - config);
+	return len;
+}
+
+static void make_interface(const char *device_dir, const char *device_name,
+			   unsigned int busnum, unsigned int ifnum,
+			   const struct fake_interface *intf)
+{
+	char name[64];
+	char path[PATH_MAX];
+	char target[PATH_MAX];
+	unsigned int j;
+
+	/* root hubs are "usbN", their interfaces "N-0:1.0" */
+	if (strncmp(device_name, "usb", 3) == 0)
+		snprintf(name, sizeof(name), "%u-0:1.%u", busnum, ifnum);
+	else
+		snprintf(name, sizeof(name), "%s:1.%u", device_name, ifnum);
+	snprintf(path, sizeof(path), "%s/%s", device_dir, name);
+	make_dirs(path);
+
+	attr(path, "bAlternateSetting", " 0");
+	attr(path, "bInterfaceClass", "%02x", intf->class);
+	attr(path, "bInterfaceNumber", "%02x", ifnum);
+	attr(path, "bInterfaceProtocol", "%02x", intf->protocol);
+	attr(path, "bInterfaceSubClass", "%02x", intf->subclass);
+	for (j = 0; j < 3 && intf->endpoints[j]; j++)
+		make_endpoint(path, intf->endpoints[j], intf->attributes[j],
+			      endpoint_packet_size(intf->attributes[j]));
+	attr(path, "bNumEndpoints", "%02x", j);
+	attr(path, "supports_autosuspend", "1");
+	attr(path, "uevent", "DEVTYPE=usb_interface\nDRIVER=%s",
+	     intf->driver ? intf->driver : "");
+	link_to(path, "subsystem", "bus/usb");
+	if (intf->driver) {
+		snprintf(target, sizeof(target), "bus/usb/drivers/%s", intf->driver);
+		link_to(path, "driver", target);
+	}
+
+	/* and the link in bus/usb/devices */
+	snprintf(target, sizeof(target), "%s", path + strlen(root) + 1);
+	snprintf(path, sizeof(path), "%s/bus/usb/devices", root);
+	link_to(path, name, target);
+}
+
+static void make_device(const char *dir, const char *name, unsigned int busnum,
+			unsigned int devnum, const char *devpath,
+			const struct fake_kind *kind, unsigned int maxchild,
+			const char *speed)
+{
+	unsigned char blob[512];
+	char path[PATH_MAX];
+	char target[PATH_MAX];
+	unsigned int i;
+	size_t len;
+
+	make_dirs(dir);
+	attr(dir, "bConfigurationValue", "1");
+	attr(dir, "bDeviceClass", "%02x", kind->class);
+	attr(dir, "bDeviceProtocol", "%02x", kind->class == 0x09 ? 1 : 0);
+	attr(dir, "bDeviceSubClass", "00");
+	attr(dir, "bMaxPacketSize0", "64");
+	attr(dir, "bMaxPower", "100mA");
+	attr(dir, "bNumConfigurations", "1");
+	attr(dir, "bNumInterfaces", "%2u", kind->ninterfaces);
+	attr(dir, "bcdDevice", "0100");
+	attr(dir, "bmAttributes", "a0");
+	attr(dir, "busnum", "%u", busnum);
+	attr(dir, "devnum", "%u", devnum);
+	attr(dir, "devpath", "%s", devpath);
+	attr(dir, "idProduct", "%04x", kind->idProduct);
+	attr(dir, "idVendor", "%04x", kind->idVendor);
+	attr(dir, "manufacturer", "%s", kind->manufacturer);
+	attr(dir, "maxchild", "%u", maxchild);
+	attr(dir, "product", "%s", kind->product);
+	attr(dir, "quirks", "0x0");
+	attr(dir, "serial", "%08X%04X", random_number() * 0x10001, devnum);
+	attr(dir, "speed", "%s", speed);
+	attr(dir, "version", " 2.00");
+	attr(dir, "uevent", "MAJOR=189\nMINOR=%u\nDEVNAME=bus/usb/%03u/%03u\n"
+	     "DEVTYPE=usb_device\nDRIVER=usb\nBUSNUM=%03u\nDEVNUM=%03u",
+	     (busnum - 1) * 128 + devnum - 1, busnum, devnum, busnum, devnum);
+	len = make_descriptors(blob, kind);
+	write_file(dir, "descriptors", blob, len);
+	make_endpoint(dir, 0x00, 0x00, 64);
+	link_to(dir, "subsystem", "bus/usb");
+	link_to(dir, "driver", "bus/usb/drivers/usb");
+
+	for (i = 0; i < kind->ninterfaces; i++)
+		make_interface(dir, name, busnum, i, &kind->interfaces[i]);
+
+	snprintf(target, sizeof(target), "%s", dir + strlen(root) + 1);
+	snprintf(path, sizeof(path), "%s/bus/usb/devices", root);
+	link_to(path, name, target);
+}
+
+/* A hub that still has room for more devices */
+struct fake_hub {
+	char dir[PATH_MAX];
+	char name[64];
+	unsigned int tier;
+	unsigned int ports_used;
+};
+
+/*
+ * Fill one bus with @count devices.  The first few are a chain of hubs down
+ * to the last tier that can have one, so every bus goes all the way down,
+ * then the rest are spread out over whichever hubs have free ports, with
+ * one in every five of them being another hub.
+ */
+static void make_bus(unsigned int busnum, unsigned int count)
+{
+	struct fake_hub *hubs;
+	struct fake_hub *hub;
+	unsigned int nhubs = 1;
+	unsigned int current = 0;
+	unsigned int devnum;
+	char dir[PATH_MAX];
+	char name[64];
+	const char *devpath;
+	const struct fake_kind *kind;
+	int is_hub;
+	int len;
+
+	hubs = calloc(count + 1, sizeof(*hubs));
+	if (hubs == NULL)
+		exit(1);
+	snprintf(hubs[0].dir, sizeof(hubs[0].dir),
+		 "%s/devices/pci0000:%02x/0000:%02x:00.0/usb%u",
+		 root, busnum, busnum, busnum);
+	snprintf(hubs[0].name, sizeof(hubs[0].name), "usb%u", busnum);
+	hubs[0].tier = 1;
+	{
+		struct fake_kind root_hub = hub_kind;
+
+		root_hub.idVendor = 0x1d6b;
+		root_hub.idProduct = 0x0002;
+		root_hub.manufacturer = "Linux Foundation";
+		root_hub.product = "2.0 root hub";
+		make_device(hubs[0].dir, hubs[0].name, busnum, 1, "0",
+			    &root_hub, HUB_PORTS, "480");
+	}
+
+	for (devnum = 2; devnum < count + 2; devnum++) {
+		/* the first hub with a free port */
+		while (current < nhubs && hubs[current].ports_used == HUB_PORTS)
+			current++;
+		if (current == nhubs)
+			break;
+		hub = &hubs[current];
+
+		/* go deep first, then every fifth device is a hub */
+		if (devnum < MAX_TIER + 1)
+			hub = &hubs[nhubs - 1];
+		hub->ports_used++;
+		if (hub->tier == 1)
+			len = snprintf(name, sizeof(name), "%u-%u", busnum, hub->ports_used);
+		else
+			len = snprintf(name, sizeof(name), "%s.%u", hub->name, hub->ports_used);
+		if (len >= (int)sizeof(name) ||
+		    snprintf(dir, sizeof(dir), "%s/%s", hub->dir, name) >= (int)sizeof(dir)) {
+			fprintf(stderr, "%s is too deep\n", hub->dir);
+			exit(1);
+		}
+		devpath = strchr(name, '-') + 1;
+
+		is_hub = hub->tier < MAX_TIER - 1 &&
+			 (devnum < MAX_TIER || random_number() % 5 == 0);
+		kind = is_hub ? &hub_kind :
+		       &device_kinds[random_number() % (sizeof(device_kinds) /
+							 sizeof(device_kinds[0]))];
+		make_device(dir, name, busnum, devnum, devpath, kind,
+			    is_hub ? HUB_PORTS : 0, is_hub ? "480" : "12");
+		if (is_hub) {
+			struct fake_hub *new_hub = &hubs[nhubs++];
+
+			snprintf(new_hub->dir, sizeof(new_hub->dir), "%s", dir);
+			snprintf(new_hub->name, sizeof(new_hub->name), "%s", name);
+			new_hub->tier = hub->tier + 1;
+		}
+	}
+	free(hubs);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char * const drivers[] = {
+		"usb", "hub", "usbhid", "usb-storage", "cdc_ether",
+		"uvcvideo", "snd-usb-audio",
+	};
+	char path[PATH_MAX];
+	unsigned int devices;
+	unsigned int busnum;
+	unsigned int nbuses;
+	unsigned int i;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s DIR DEVICES\n", argv[0]);
+		return 1;
+	}
+	root = argv[1];
+	devices = strtoul(argv[2], NULL, 10);
+	if (devices == 0) {
+		fprintf(stderr, "%s: no devices?\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(drivers) / sizeof(drivers[0]); i++) {
+		snprintf(path, sizeof(path), "%s/bus/usb/drivers/%s", root, drivers[i]);
+		make_dirs(path);
+	}
+	snprintf(path, sizeof(path), "%s/bus/usb/devices", root);
+	make_dirs(path);
+
+	/* the root hubs count as devices too */
+	nbuses = (devices + DEVICES_PER_BUS) / (DEVICES_PER_BUS + 1);
+	if (nbuses == 0)
+		nbuses = 1;
+	for (busnum = 1; busnum <= nbuses; busnum++) {
+		unsigned int count = (devices - nbuses) / nbuses;
+
+		if (busnum <= (devices - nbuses) % nbuses)
+			count++;
+		make_bus(busnum, count);
+	}
+	return 0;
+}
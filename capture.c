@@ -0,0 +1,320 @@
+/*
+ * capture.c
+ *
+ * Copy the parts of sysfs that lsusb reads somewhere else, so the same scan
+ * can be run later with --sysroot, on a machine without the hardware.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+/*
+ * The tree looks just like the real one: the bus/usb/devices links point
+ * to the same places under devices/, so any path lsusb works out on the way
+ * resolves the same.  Only what a scan reads gets copied: the attributes
+ * of each device and interface, their endpoint directories, and the driver
+ * and subsystem links.  Other subsystems hanging off an interface (input,
+ * hidraw, net, ...) are left alone.
+ *
+ * Where the links lead is up to whatever tree --sysroot points at, which may
+ * be somebody else's capture, so nothing is made until it is certain to end
+ * up inside the capture.
+ */
+
+/* mkdir -p, ".." in the middle is fine as long as what is before it exists */
+static int make_dirs(const char *path)
+{
+	char temp[PATH_MAX];
+	char *slash;
+
+	if (snprintf(temp, sizeof(temp), "%s", path) >= (int)sizeof(temp))
+		return -1;
+	for (slash = strchr(temp + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		if (mkdir(temp, 0755) && errno != EEXIST)
+			return -1;
+		*slash = '/';
+	}
+	if (mkdir(temp, 0755) && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+/*
+ * Where a bus/usb/devices link leads, relative to @root/bus/usb/devices.  It
+ * has to stay inside @root, and can't go through anything in it that is not
+ * a directory: the driver and subsystem links in there point anywhere at all.
+ * Going by the names is enough then, as nothing on the way is a link.
+ */
+static int check_target(const char *root, const char *target)
+{
+	char path[PATH_MAX];
+	struct stat stat_buf;
+	int depth = 3;		/* bus/usb/devices */
+	size_t len;
+	size_t n;
+	char *slash;
+
+	if (target[0] == '/')
+		return -1;
+	len = snprintf(path, sizeof(path), "%s/bus/usb/devices", root);
+	if (len >= sizeof(path))
+		return -1;
+	while (*target) {
+		n = strcspn(target, "/");
+		if (n == 2 && strncmp(target, "..", 2) == 0) {
+			if (--depth < 0)
+				return -1;
+			slash = strrchr(path, '/');
+			*slash = '\0';
+			len = slash - path;
+		} else if (n > 0 && !(n == 1 && target[0] == '.')) {
+			if (len + 1 + n >= sizeof(path))
+				return -1;
+			path[len++] = '/';
+			memcpy(path + len, target, n);
+			len += n;
+			path[len] = '\0';
+			depth++;
+			if (lstat(path, &stat_buf) == 0 && !S_ISDIR(stat_buf.st_mode))
+				return -1;
+		}
+		target += n;
+		while (*target == '/')
+			target++;
+	}
+	/* and not @root itself */
+	return depth > 0 ? 0 : -1;
+}
+
+/*
+ * sysfs says every file is 4096 bytes long, so read until the end instead
+ * of trusting that.  Files we can't read (write only ones like "remove", or
+ * ones that fail while a device is suspended) are just skipped.  Nothing
+ * lsusb reads comes near the size of the buffer, but if something does it
+ * gets said, rather than leaving a capture that is quietly different.
+ */
+static void copy_file(int dirfd, const char *name, const char *to)
+{
+	char buffer[65536];
+	char path[PATH_MAX];
+	ssize_t len = 0;
+	ssize_t retval = 0;
+	int truncated;
+	char more;
+	int in;
+	int out;
+
+	in = openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	if (in == -1)
+		return;
+	while ((size_t)len < sizeof(buffer)) {
+		retval = read(in, buffer + len, sizeof(buffer) - len);
+		if (retval <= 0)
+			break;
+		len += retval;
+	}
+	truncated = retval > 0 && read(in, &more, 1) > 0;
+	close(in);
+	if (retval < 0)
+		return;
+
+	snprintf(path, sizeof(path), "%s/%s", to, name);
+	if (truncated)
+		fprintf(stderr, "only the first %zu bytes of %s were captured\n",
+			sizeof(buffer), path);
+	out = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW,
+		   0644);
+	if (out == -1) {
+		fprintf(stderr, "can't create %s\n", path);
+		exit(1);
+	}
+	if (write(out, buffer, len) != len) {
+		fprintf(stderr, "can't write %s\n", path);
+		exit(1);
+	}
+	close(out);
+}
+
+static void copy_link(int dirfd, const char *name, const char *to)
+{
+	char target[PATH_MAX];
+	char path[PATH_MAX];
+	ssize_t len;
+
+	len = readlinkat(dirfd, name, target, sizeof(target) - 1);
+	if (len <= 0)
+		return;
+	target[len] = '\0';
+	snprintf(path, sizeof(path), "%s/%s", to, name);
+	unlink(path);
+	if (symlink(target, path)) {
+		fprintf(stderr, "can't create %s\n", path);
+		exit(1);
+	}
+}
+
+/* The directory a driver link points at, so the link is not dangling */
+static void make_driver_dir(const char *root, int dirfd)
+{
+	char target[PATH_MAX];
+	char path[PATH_MAX];
+	const char *name;
+	ssize_t len;
+
+	len = readlinkat(dirfd, "driver", target, sizeof(target) - 1);
+	if (len <= 0)
+		return;
+	target[len] = '\0';
+	name = strrchr(target, '/');
+	name = name ? name + 1 : target;
+	if (snprintf(path, sizeof(path), "%s/bus/usb/drivers/%s", root, name) >=
+	    (int)sizeof(path) || make_dirs(path)) {
+		fprintf(stderr, "can't create %s\n", path);
+		exit(1);
+	}
+}
+
+/* Copy the files of one directory, and the endpoints below it if @top */
+static void copy_dir(const char *root, int dirfd, const char *to, int top)
+{
+	char path[PATH_MAX];
+	struct stat stat_buf;
+	struct dirent *dirent;
+	DIR *dir;
+	int fd;
+
+	/* a link by the name of an endpoint would take the files elsewhere */
+	if (make_dirs(to) || lstat(to, &stat_buf) || !S_ISDIR(stat_buf.st_mode)) {
+		fprintf(stderr, "can't create %s\n", to);
+		exit(1);
+	}
+	fd = dup(dirfd);
+	dir = fd == -1 ? NULL : fdopendir(fd);
+	if (dir == NULL) {
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+	while ((dirent = readdir(dir)) != NULL) {
+		const char *name = dirent->d_name;
+
+		switch (dirent->d_type) {
+		case DT_REG:
+			copy_file(dirfd, name, to);
+			break;
+		case DT_LNK:
+			if (top && (strcmp(name, "driver") == 0 ||
+				    strcmp(name, "subsystem") == 0))
+				copy_link(dirfd, name, to);
+			break;
+		case DT_DIR:
+			if (!top || strncmp(name, "ep_", 3) != 0)
+				break;
+			fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd == -1)
+				break;
+			snprintf(path, sizeof(path), "%s/%s", to, name);
+			copy_dir(root, fd, path, 0);
+			close(fd);
+			break;
+		}
+	}
+	closedir(dir);
+	if (top)
+		make_driver_dir(root, dirfd);
+}
+
+/*
+ * Capture everything in sysfs_root/bus/usb/devices, devices and interfaces
+ * alike, into @root.
+ */
+int capture_sysfs(const char *root)
+{
+	char from[PATH_MAX];
+	char to[PATH_MAX];
+	char target[PATH_MAX];
+	struct dirent *dirent;
+	ssize_t len;
+	DIR *dir;
+	int busfd;
+	int fd;
+
+	snprintf(from, sizeof(from), "%s/bus/usb/devices", sysfs_root);
+	snprintf(to, sizeof(to), "%s/bus/usb/devices", root);
+	dir = opendir(from);
+	if (dir == NULL) {
+		fprintf(stderr, "can't read the usb devices in %s\n", sysfs_root);
+		return -1;
+	}
+	if (make_dirs(to)) {
+		fprintf(stderr, "can't create %s\n", to);
+		closedir(dir);
+		return -1;
+	}
+	busfd = dirfd(dir);
+
+	while ((dirent = readdir(dir)) != NULL) {
+		if (dirent->d_type != DT_LNK)
+			continue;
+		len = readlinkat(busfd, dirent->d_name, target, sizeof(target) - 1);
+		if (len <= 0)
+			continue;
+		target[len] = '\0';
+		if (check_target(root, target)) {
+			fprintf(stderr, "%s/%s leads outside of %s, not captured\n",
+				from, dirent->d_name, root);
+			continue;
+		}
+		fd = openat(busfd, dirent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+
+		/* the device itself, where the link says it is */
+		if (snprintf(to, sizeof(to), "%s/bus/usb/devices/%s", root, target) >=
+		    (int)sizeof(to)) {
+			fprintf(stderr, "%s is too deep\n", target);
+			exit(1);
+		}
+		copy_dir(root, fd, to, 1);
+		close(fd);
+
+		/* and the link */
+		snprintf(to, sizeof(to), "%s/bus/usb/devices", root);
+		fd = open(to, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd == -1) {
+			fprintf(stderr, "can't open %s\n", to);
+			exit(1);
+		}
+		unlinkat(fd, dirent->d_name, 0);
+		if (symlinkat(target, fd, dirent->d_name)) {
+			fprintf(stderr, "can't create %s/%s\n", to, dirent->d_name);
+			exit(1);
+		}
+		close(fd);
+	}
+	closedir(dir);
+	return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * daemon.c
+ *
+ * Keep the device list around, current from the uevents, and hand it out to
+ * anyone who asks over a unix socket.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+/*
+ * The protocol is one line from the client:
+ *
+ *	list [bus N] [dev N] [id [vvvv][:pppp]] [class CC] [sort busdev|id|path]
+ *	     [format text|json|ndjson]
+ *
+ * and the daemon writes back "ok" on a line of its own, then the same listing
+ * lsusb would print, and closes the connection.  Anything it does not
+ * understand gets a line starting with "error:" back instead.
+ */
+#define QUERY_SIZE	256
+#define MAX_CLIENTS	64	/* sending their query, or reading the answer */
+#define QUERY_TIMEOUT	1000	/* ms they get to send it in */
+#define CLIENT_TIMEOUT	10000	/* ms from connecting to having it all read */
+
+struct client {
+	int fd;
+	long long accepted;
+	long long deadline;
+	size_t len;
+	char query[QUERY_SIZE];
+	char *answer;		/* NULL until the whole query is in */
+	size_t answer_size;
+	size_t sent;
+};
+
+static int unix_address(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path))
+		return -1;
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+static int daemon_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (unix_address(path, &addr))
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	/* whatever is there is left over from a daemon that died */
+	unlink(path);
+	/*
+	 * Anyone can read the devices out of sysfs themselves, so anyone may
+	 * ask us too, whatever the umask is.
+	 */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    chmod(path, 0666) || listen(fd, 16)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int parse_query(char *query, struct usb_filter *filter,
+		       enum usb_sort_key *key,
+		       const struct usb_formatter **formatter)
+{
+	char *word;
+	char *value;
+	char *save;
+
+	word = strtok_r(query, " \t\r\n", &save);
+	if (word == NULL || strcmp(word, "list") != 0)
+		return -1;
+	while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		value = strtok_r(NULL, " \t\r\n", &save);
+		if (value == NULL)
+			return -1;
+		if (strcmp(word, "sort") == 0) {
+			if (parse_usb_sort_key(value, key))
+				return -1;
+		} else if (strcmp(word, "format") == 0) {
+			*formatter = find_usb_formatter(value);
+			if (*formatter == NULL)
+				return -1;
+		} else if (parse_usb_filter(filter, word, value)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Read what the client has sent so far, without waiting for more.  Returns
+ * 1 once there is a whole query (or all there is going to be).
+ */
+static int read_query(struct client *client)
+{
+	ssize_t retval;
+
+	retval = read(client->fd, client->query + client->len,
+		      sizeof(client->query) - 1 - client->len);
+	if (retval < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (retval <= 0)
+		return 1;
+	client->len += retval;
+	return memchr(client->query, '\n', client->len) != NULL ||
+	       client->len == sizeof(client->query) - 1;
+}
+
+/*
+ * Work out the answer to a query, all of it, straight away.  Everything comes
+ * out of the list we already have, so all this costs is the formatting (and
+ * a sort, if the list is not in the order asked for already).  It is then
+ * sent by send_answer() as fast as the client takes it.
+ */
+static void answer_query(struct client *client, enum usb_sort_key key,
+			 int *sorted_by)
+{
+	const struct usb_formatter *formatter = &text_formatter;
+	static struct outbuf out;
+	struct usb_filter filter;
+
+	client->query[client->len] = '\0';
+	out_init(&out, -1);
+	init_usb_filter(&filter);
+	if (parse_query(client->query, &filter, &key, &formatter)) {
+		out_str(&out, "error: can't parse query\n");
+	} else {
+		if (*sorted_by != (int)key) {
+			sort_usb_devices(&usb_devices, key);
+			*sorted_by = key;
+		}
+		out_mem(&out, "ok\n", 3);
+		format_usb_devices(&out, &usb_devices, &filter, formatter);
+	}
+	client->answer = out_take(&out, &client->answer_size);
+	client->sent = 0;
+	client->deadline = client->accepted + CLIENT_TIMEOUT;
+}
+
+/*
+ * Write as much of the answer as the client has room for.  Returns 1 once
+ * there is nothing more to send, because it all went or the client went.
+ */
+static int send_answer(struct client *client)
+{
+	ssize_t retval;
+
+	while (client->sent < client->answer_size) {
+		retval = write(client->fd, client->answer + client->sent,
+			       client->answer_size - client->sent);
+		if (retval < 0 && errno == EINTR)
+			continue;
+		if (retval < 0 && errno == EAGAIN)
+			return 0;
+		if (retval <= 0)
+			return 1;
+		client->sent += retval;
+	}
+	return 1;
+}
+
+static void drop_client(struct client *client)
+{
+	close(client->fd);
+	free(client->answer);
+}
+
+/*
+ * Run until we get killed.  The devices were all read in up front by the
+ * initial scan, so from here on sysfs is only touched for uevents.
+ *
+ * Nothing here ever waits on a client.  Each one is in @clients until it has
+ * sent its query and read all of the answer, and gets QUERY_TIMEOUT for the
+ * one and CLIENT_TIMEOUT for all of it, however slowly it goes, before it is
+ * dropped.  If MAX_CLIENTS of them are in, new ones wait in the listen
+ * backlog.  Uevents are handled in between, so the list stays current.
+ *
+ * The list comes sorted by @key from the initial scan, and is only sorted
+ * again when a query wants it in some other order, or devices came and went.
+ */
+int run_daemon(const char *path, int monitor_fd, enum usb_sort_key key)
+{
+	struct pollfd pfd[2 + MAX_CLIENTS];
+	struct client clients[MAX_CLIENTS];
+	struct client *client;
+	unsigned int nclients = 0;
+	unsigned int i;
+	int sorted_by = key;
+	long long deadline;
+	long long now;
+	int listen_fd;
+	int timeout;
+	int done;
+	int fd;
+
+	listen_fd = daemon_listen(path);
+	if (listen_fd == -1) {
+		fprintf(stderr, "can't listen on %s\n", path);
+		return 1;
+	}
+	pfd[0].events = POLLIN;
+	pfd[1].fd = monitor_fd;
+	pfd[1].events = POLLIN;
+
+	/* clients that go away early are their own problem */
+	signal(SIGPIPE, SIG_IGN);
+
+	while (1) {
+		pfd[0].fd = nclients < MAX_CLIENTS ? listen_fd : -1;
+		deadline = -1;
+		for (i = 0; i < nclients; i++) {
+			pfd[2 + i].fd = clients[i].fd;
+			pfd[2 + i].events = clients[i].answer ? POLLOUT : POLLIN;
+			if (deadline == -1 || clients[i].deadline < deadline)
+				deadline = clients[i].deadline;
+		}
+		timeout = -1;
+		if (deadline != -1) {
+			now = now_ms();
+			timeout = deadline > now ? deadline - now : 0;
+		}
+		if (poll(pfd, 2 + nclients, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		/* keep the list current before answering anyone */
+		if (pfd[1].revents & POLLIN) {
+			watch_event();
+			/* new devices went on the end, or all of them were read again */
+			sorted_by = -1;
+		}
+
+		now = now_ms();
+		for (i = nclients; i-- > 0;) {
+			client = &clients[i];
+			done = 0;
+			if (pfd[2 + i].revents && client->answer == NULL &&
+			    read_query(client)) {
+				answer_query(client, key, &sorted_by);
+				/* most answers go in one write, no need to wait */
+				done = client->answer == NULL || send_answer(client);
+			} else if (pfd[2 + i].revents && client->answer) {
+				done = send_answer(client);
+			}
+			if (!done && now < client->deadline)
+				continue;
+			drop_client(client);
+			nclients--;
+			memmove(&clients[i], &clients[i + 1],
+				(nclients - i) * sizeof(clients[0]));
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			fd = accept(listen_fd, NULL, NULL);
+			if (fd != -1) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				client = &clients[nclients++];
+				memset(client, 0, sizeof(*client));
+				client->fd = fd;
+				client->accepted = now;
+				client->deadline = now + QUERY_TIMEOUT;
+			}
+		}
+	}
+	for (i = 0; i < nclients; i++)
+		drop_client(&clients[i]);
+	close(listen_fd);
+	unlink(path);
+	sysfs_monitor_end();
+	return 1;
+}
+
+/*
+ * Client side.  Returns -1 if there is no daemon to ask (or it does not say
+ * anything), so the caller can go and scan for itself.
+ */
+int query_daemon(const char *path, const struct usb_filter *filter,
+		 enum usb_sort_key key, const struct usb_formatter *formatter)
+{
+	struct sockaddr_un addr;
+	char query[QUERY_SIZE];
+	char filters[QUERY_SIZE / 2];
+	char buffer[8192];
+	size_t len;
+	FILE *file;
+	int fd;
+
+	if (unix_address(path, &addr))
+		return -1;
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	format_usb_filter(filter, filters, sizeof(filters));
+	snprintf(query, sizeof(query), "list%s sort %s format %s\n", filters,
+		 usb_sort_key_name(key), formatter->name);
+	if (write(fd, query, strlen(query)) != (ssize_t)strlen(query)) {
+		close(fd);
+		return -1;
+	}
+	shutdown(fd, SHUT_WR);
+
+	file = fdopen(fd, "r");
+	if (file == NULL) {
+		close(fd);
+		return -1;
+	}
+	if (fgets(buffer, sizeof(buffer), file) == NULL ||
+	    strcmp(buffer, "ok\n") != 0) {
+		fclose(file);
+		return -1;
+	}
+	while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		fwrite(buffer, 1, len, stdout);
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,819 @@
+/*
+ * decode.c
+ *
+ * Spell out every field of every descriptor in a "descriptors" file, for
+ * lsusb -v.  What is in a descriptor is described by the tables in here,
+ * not by code: each field has a name, where it is, how wide it is and how
+ * to show it, so one loop prints them all.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+enum field_format {
+	FIELD_DEC,
+	FIELD_HEX,		/* 0x0409, as many digits as it is wide */
+	FIELD_BCD,		/* 2.00 */
+	FIELD_ENDPOINT,		/* 0x81  EP 1 IN */
+	FIELD_TRANSFER,		/* 3  Interrupt */
+	FIELD_POWER,		/* 50  100mA */
+	FIELD_BYTES,		/* 01 02 03, a width of 0 is up to the end */
+};
+
+struct descriptor_field {
+	const char *name;
+	unsigned char offset;
+	unsigned char width;
+	unsigned char format;
+};
+
+/*
+ * Class specific descriptors only mean something inside an interface of
+ * their class, and most of them are told apart by their subtype as well.
+ */
+#define MATCH_CLASS	0x01
+#define MATCH_SUBCLASS	0x02
+#define MATCH_SUBTYPE	0x04
+
+struct descriptor_table {
+	const char *title;
+	unsigned char type;
+	unsigned char match;
+	unsigned char class;
+	unsigned char subclass;
+	unsigned char subtype;
+	unsigned char depth;		/* how far it is indented */
+	const struct descriptor_field *fields;
+	unsigned int nfields;
+};
+
+#define F(name, offset, width, format)	{ name, offset, width, FIELD_##format }
+
+#define STANDARD(title, type, depth, fields)				\
+	{ title, type, 0, 0, 0, 0, depth, fields, ARRAY_SIZE(fields) }
+#define CLASS(title, type, class, depth, fields)			\
+	{ title, type, MATCH_CLASS, class, 0, 0, depth, fields,		\
+	  ARRAY_SIZE(fields) }
+#define SUBTYPE(title, type, class, subtype, fields)			\
+	{ title, type, MATCH_CLASS | MATCH_SUBTYPE, class, 0, subtype,	\
+	  3, fields, ARRAY_SIZE(fields) }
+#define SUBCLASS(title, type, class, subclass, subtype, fields)		\
+	{ title, type, MATCH_CLASS | MATCH_SUBCLASS | MATCH_SUBTYPE,	\
+	  class, subclass, subtype, 3, fields, ARRAY_SIZE(fields) }
+
+/* every descriptor starts with these, the tables start after them */
+static const struct descriptor_field header_fields[] = {
+	F("bLength",			0, 1, DEC),
+	F("bDescriptorType",		1, 1, DEC),
+};
+
+/* standard descriptors, chapter 9 of the USB spec */
+static const struct descriptor_field device_fields[] = {
+	F("bcdUSB",			2, 2, BCD),
+	F("bDeviceClass",		4, 1, DEC),
+	F("bDeviceSubClass",		5, 1, DEC),
+	F("bDeviceProtocol",		6, 1, DEC),
+	F("bMaxPacketSize0",		7, 1, DEC),
+	F("idVendor",			8, 2, HEX),
+	F("idProduct",			10, 2, HEX),
+	F("bcdDevice",			12, 2, BCD),
+	F("iManufacturer",		14, 1, DEC),
+	F("iProduct",			15, 1, DEC),
+	F("iSerial",			16, 1, DEC),
+	F("bNumConfigurations",		17, 1, DEC),
+};
+
+static const struct descriptor_field config_fields[] = {
+	F("wTotalLength",		2, 2, HEX),
+	F("bNumInterfaces",		4, 1, DEC),
+	F("bConfigurationValue",	5, 1, DEC),
+	F("iConfiguration",		6, 1, DEC),
+	F("bmAttributes",		7, 1, HEX),
+	F("MaxPower",			8, 1, POWER),
+};
+
+static const struct descriptor_field string_fields[] = {
+	F("bString",			2, 0, BYTES),
+};
+
+static const struct descriptor_field interface_fields[] = {
+	F("bInterfaceNumber",		2, 1, DEC),
+	F("bAlternateSetting",		3, 1, DEC),
+	F("bNumEndpoints",		4, 1, DEC),
+	F("bInterfaceClass",		5, 1, DEC),
+	F("bInterfaceSubClass",		6, 1, DEC),
+	F("bInterfaceProtocol",		7, 1, DEC),
+	F("iInterface",			8, 1, DEC),
+};
+
+static const struct descriptor_field endpoint_fields[] = {
+	F("bEndpointAddress",		2, 1, ENDPOINT),
+	F("bmAttributes",		3, 1, TRANSFER),
+	F("wMaxPacketSize",		4, 2, HEX),
+	F("bInterval",			6, 1, DEC),
+	F("bRefresh",			7, 1, DEC),	/* audio only */
+	F("bSynchAddress",		8, 1, DEC),
+};
+
+static const struct descriptor_field qualifier_fields[] = {
+	F("bcdUSB",			2, 2, BCD),
+	F("bDeviceClass",		4, 1, DEC),
+	F("bDeviceSubClass",		5, 1, DEC),
+	F("bDeviceProtocol",		6, 1, DEC),
+	F("bMaxPacketSize0",		7, 1, DEC),
+	F("bNumConfigurations",		8, 1, DEC),
+	F("bReserved",			9, 1, DEC),
+};
+
+static const struct descriptor_field interface_power_fields[] = {
+	F("bmCapabilities",		2, 1, HEX),
+	F("bSelfPowerState",		3, 1, DEC),
+	F("bBusPowerState",		4, 1, DEC),
+	F("bwPowerSpec",		5, 0, BYTES),
+};
+
+static const struct descriptor_field otg_fields[] = {
+	F("bmAttributes",		2, 1, HEX),
+	F("bcdOTG",			3, 2, BCD),
+};
+
+static const struct descriptor_field debug_fields[] = {
+	F("bDebugInEndpoint",		2, 1, ENDPOINT),
+	F("bDebugOutEndpoint",		3, 1, ENDPOINT),
+};
+
+static const struct descriptor_field association_fields[] = {
+	F("bFirstInterface",		2, 1, DEC),
+	F("bInterfaceCount",		3, 1, DEC),
+	F("bFunctionClass",		4, 1, DEC),
+	F("bFunctionSubClass",		5, 1, DEC),
+	F("bFunctionProtocol",		6, 1, DEC),
+	F("iFunction",			7, 1, DEC),
+};
+
+static const struct descriptor_field bos_fields[] = {
+	F("wTotalLength",		2, 2, HEX),
+	F("bNumDeviceCaps",		4, 1, DEC),
+};
+
+static const struct descriptor_field capability_fields[] = {
+	F("bDevCapabilityType",		2, 1, DEC),
+	F("data",			3, 0, BYTES),
+};
+
+static const struct descriptor_field ss_companion_fields[] = {
+	F("bMaxBurst",			2, 1, DEC),
+	F("bmAttributes",		3, 1, HEX),
+	F("wBytesPerInterval",		4, 2, DEC),
+};
+
+static const struct descriptor_field ssp_iso_companion_fields[] = {
+	F("wReserved",			2, 2, HEX),
+	F("dwBytesPerInterval",		4, 4, DEC),
+};
+
+static const struct descriptor_field unknown_fields[] = {
+	F("data",			2, 0, BYTES),
+};
+
+/* indexed by bDescriptorType */
+static const struct descriptor_table standard_descriptors[] = {
+	[0x01] = STANDARD("Device Descriptor:", 0x01, 0, device_fields),
+	[0x02] = STANDARD("Configuration Descriptor:", 0x02, 1, config_fields),
+	[0x03] = STANDARD("String Descriptor:", 0x03, 1, string_fields),
+	[0x04] = STANDARD("Interface Descriptor:", 0x04, 2, interface_fields),
+	[0x05] = STANDARD("Endpoint Descriptor:", 0x05, 3, endpoint_fields),
+	[0x06] = STANDARD("Device Qualifier:", 0x06, 0, qualifier_fields),
+	[0x07] = STANDARD("Other Speed Configuration Descriptor:", 0x07, 1,
+			  config_fields),
+	[0x08] = STANDARD("Interface Power Descriptor:", 0x08, 2,
+			  interface_power_fields),
+	[0x09] = STANDARD("OTG Descriptor:", 0x09, 1, otg_fields),
+	[0x0a] = STANDARD("Debug Descriptor:", 0x0a, 0, debug_fields),
+	[0x0b] = STANDARD("Interface Association:", 0x0b, 2, association_fields),
+	[0x0f] = STANDARD("Binary Object Store Descriptor:", 0x0f, 0, bos_fields),
+	[0x10] = STANDARD("Device Capability Descriptor:", 0x10, 1,
+			  capability_fields),
+	[0x30] = STANDARD("SuperSpeed Endpoint Companion:", 0x30, 4,
+			  ss_companion_fields),
+	[0x31] = STANDARD("SuperSpeedPlus Isochronous Endpoint Companion:", 0x31, 4,
+			  ssp_iso_companion_fields),
+};
+
+/* HID, class 3 */
+static const struct descriptor_field hid_fields[] = {
+	F("bcdHID",			2, 2, BCD),
+	F("bCountryCode",		4, 1, DEC),
+	F("bNumDescriptors",		5, 1, DEC),
+	F("bDescriptorType",		6, 1, DEC),
+	F("wDescriptorLength",		7, 2, DEC),
+	F("more",			9, 0, BYTES),
+};
+
+/* hubs, class 9 */
+static const struct descriptor_field hub_fields[] = {
+	F("nNbrPorts",			2, 1, DEC),
+	F("wHubCharacteristic",		3, 2, HEX),
+	F("bPwrOn2PwrGood",		5, 1, DEC),
+	F("bHubContrCurrent",		6, 1, DEC),
+	F("DeviceRemovable",		7, 0, BYTES),
+};
+
+static const struct descriptor_field ss_hub_fields[] = {
+	F("nNbrPorts",			2, 1, DEC),
+	F("wHubCharacteristic",		3, 2, HEX),
+	F("bPwrOn2PwrGood",		5, 1, DEC),
+	F("bHubContrCurrent",		6, 1, DEC),
+	F("bHubHdrDecLat",		7, 1, DEC),
+	F("wHubDelay",			8, 2, DEC),
+	F("DeviceRemovable",		10, 2, HEX),
+};
+
+/* audio, class 1: control is subclass 1, streaming subclass 2 */
+static const struct descriptor_field audio_header_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bcdADC",			3, 2, BCD),
+	F("wTotalLength",		5, 2, HEX),
+	F("bInCollection",		7, 1, DEC),
+	F("baInterfaceNr",		8, 0, BYTES),
+};
+
+static const struct descriptor_field audio_input_terminal_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bTerminalID",		3, 1, DEC),
+	F("wTerminalType",		4, 2, HEX),
+	F("bAssocTerminal",		6, 1, DEC),
+	F("bNrChannels",		7, 1, DEC),
+	F("wChannelConfig",		8, 2, HEX),
+	F("iChannelNames",		10, 1, DEC),
+	F("iTerminal",			11, 1, DEC),
+};
+
+static const struct descriptor_field audio_output_terminal_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bTerminalID",		3, 1, DEC),
+	F("wTerminalType",		4, 2, HEX),
+	F("bAssocTerminal",		6, 1, DEC),
+	F("bSourceID",			7, 1, DEC),
+	F("iTerminal",			8, 1, DEC),
+};
+
+static const struct descriptor_field audio_mixer_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("bNrInPins",			4, 1, DEC),
+	F("baSourceID",			5, 0, BYTES),
+};
+
+static const struct descriptor_field audio_selector_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("bNrInPins",			4, 1, DEC),
+	F("baSourceID",			5, 0, BYTES),
+};
+
+static const struct descriptor_field audio_feature_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("bSourceID",			4, 1, DEC),
+	F("bControlSize",		5, 1, DEC),
+	F("bmaControls",		6, 0, BYTES),
+};
+
+static const struct descriptor_field audio_streaming_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bTerminalLink",		3, 1, DEC),
+	F("bDelay",			4, 1, DEC),
+	F("wFormatTag",			5, 2, HEX),
+};
+
+static const struct descriptor_field audio_format_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bFormatType",		3, 1, DEC),
+	F("bNrChannels",		4, 1, DEC),
+	F("bSubframeSize",		5, 1, DEC),
+	F("bBitResolution",		6, 1, DEC),
+	F("bSamFreqType",		7, 1, DEC),
+	F("tSamFreq",			8, 0, BYTES),
+};
+
+static const struct descriptor_field audio_endpoint_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bmAttributes",		3, 1, HEX),
+	F("bLockDelayUnits",		4, 1, DEC),
+	F("wLockDelay",			5, 2, DEC),
+};
+
+/* video, class 0x0e: control is subclass 1, streaming subclass 2 */
+static const struct descriptor_field video_header_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bcdUVC",			3, 2, BCD),
+	F("wTotalLength",		5, 2, HEX),
+	F("dwClockFrequency",		7, 4, DEC),
+	F("bInCollection",		11, 1, DEC),
+	F("baInterfaceNr",		12, 0, BYTES),
+};
+
+static const struct descriptor_field video_input_terminal_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bTerminalID",		3, 1, DEC),
+	F("wTerminalType",		4, 2, HEX),
+	F("bAssocTerminal",		6, 1, DEC),
+	F("iTerminal",			7, 1, DEC),
+	F("wObjectiveFocalLengthMin",	8, 2, DEC),
+	F("wObjectiveFocalLengthMax",	10, 2, DEC),
+	F("wOcularFocalLength",		12, 2, DEC),
+	F("bControlSize",		14, 1, DEC),
+	F("bmControls",			15, 0, BYTES),
+};
+
+static const struct descriptor_field video_output_terminal_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bTerminalID",		3, 1, DEC),
+	F("wTerminalType",		4, 2, HEX),
+	F("bAssocTerminal",		6, 1, DEC),
+	F("bSourceID",			7, 1, DEC),
+	F("iTerminal",			8, 1, DEC),
+};
+
+static const struct descriptor_field video_selector_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("bNrInPins",			4, 1, DEC),
+	F("baSourceID",			5, 0, BYTES),
+};
+
+static const struct descriptor_field video_processing_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("bSourceID",			4, 1, DEC),
+	F("wMaxMultiplier",		5, 2, DEC),
+	F("bControlSize",		7, 1, DEC),
+	F("bmControls",			8, 0, BYTES),
+};
+
+static const struct descriptor_field video_extension_unit_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bUnitID",			3, 1, DEC),
+	F("guidExtensionCode",		4, 16, BYTES),
+	F("bNumControls",		20, 1, DEC),
+	F("bNrInPins",			21, 1, DEC),
+	F("baSourceID",			22, 0, BYTES),
+};
+
+static const struct descriptor_field video_input_header_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bNumFormats",		3, 1, DEC),
+	F("wTotalLength",		4, 2, HEX),
+	F("bEndpointAddress",		6, 1, ENDPOINT),
+	F("bmInfo",			7, 1, HEX),
+	F("bTerminalLink",		8, 1, DEC),
+	F("bStillCaptureMethod",	9, 1, DEC),
+	F("bTriggerSupport",		10, 1, DEC),
+	F("bTriggerUsage",		11, 1, DEC),
+	F("bControlSize",		12, 1, DEC),
+	F("bmaControls",		13, 0, BYTES),
+};
+
+static const struct descriptor_field video_format_uncompressed_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bFormatIndex",		3, 1, DEC),
+	F("bNumFrameDescriptors",	4, 1, DEC),
+	F("guidFormat",			5, 16, BYTES),
+	F("bBitsPerPixel",		21, 1, DEC),
+	F("bDefaultFrameIndex",		22, 1, DEC),
+	F("bAspectRatioX",		23, 1, DEC),
+	F("bAspectRatioY",		24, 1, DEC),
+	F("bmInterlaceFlags",		25, 1, HEX),
+	F("bCopyProtect",		26, 1, DEC),
+};
+
+static const struct descriptor_field video_format_mjpeg_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bFormatIndex",		3, 1, DEC),
+	F("bNumFrameDescriptors",	4, 1, DEC),
+	F("bFlags",			5, 1, HEX),
+	F("bDefaultFrameIndex",		6, 1, DEC),
+	F("bAspectRatioX",		7, 1, DEC),
+	F("bAspectRatioY",		8, 1, DEC),
+	F("bmInterlaceFlags",		9, 1, HEX),
+	F("bCopyProtect",		10, 1, DEC),
+};
+
+/* the uncompressed and MJPEG frames look the same */
+static const struct descriptor_field video_frame_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bFrameIndex",		3, 1, DEC),
+	F("bmCapabilities",		4, 1, HEX),
+	F("wWidth",			5, 2, DEC),
+	F("wHeight",			7, 2, DEC),
+	F("dwMinBitRate",		9, 4, DEC),
+	F("dwMaxBitRate",		13, 4, DEC),
+	F("dwMaxVideoFrameBufferSize",	17, 4, DEC),
+	F("dwDefaultFrameInterval",	21, 4, DEC),
+	F("bFrameIntervalType",		25, 1, DEC),
+	F("dwFrameInterval",		26, 0, BYTES),
+};
+
+static const struct descriptor_field video_still_frame_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bEndpointAddress",		3, 1, ENDPOINT),
+	F("bNumImageSizePatterns",	4, 1, DEC),
+	F("wWidth/wHeight",		5, 0, BYTES),
+};
+
+static const struct descriptor_field video_color_format_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bColorPrimaries",		3, 1, DEC),
+	F("bTransferCharacteristics",	4, 1, DEC),
+	F("bMatrixCoefficients",	5, 1, DEC),
+};
+
+static const struct descriptor_field video_endpoint_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("wMaxTransferSize",		3, 2, DEC),
+};
+
+/* communications, class 2, the functional descriptors */
+static const struct descriptor_field cdc_header_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bcdCDC",			3, 2, BCD),
+};
+
+static const struct descriptor_field cdc_call_management_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bmCapabilities",		3, 1, HEX),
+	F("bDataInterface",		4, 1, DEC),
+};
+
+static const struct descriptor_field cdc_acm_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bmCapabilities",		3, 1, HEX),
+};
+
+static const struct descriptor_field cdc_union_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bMasterInterface",		3, 1, DEC),
+	F("bSlaveInterface",		4, 0, BYTES),
+};
+
+static const struct descriptor_field cdc_country_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("iCountryCodeRelDate",	3, 1, DEC),
+	F("wCountryCode",		4, 0, BYTES),
+};
+
+static const struct descriptor_field cdc_ethernet_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("iMACAddress",		3, 1, DEC),
+	F("bmEthernetStatistics",	4, 4, HEX),
+	F("wMaxSegmentSize",		8, 2, DEC),
+	F("wNumberMCFilters",		10, 2, HEX),
+	F("bNumberPowerFilters",	12, 1, DEC),
+};
+
+static const struct descriptor_field cdc_ncm_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bcdNcmVersion",		3, 2, BCD),
+	F("bmNetworkCapabilities",	5, 1, HEX),
+};
+
+static const struct descriptor_field cdc_mbim_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("bcdMBIMVersion",		3, 2, BCD),
+	F("wMaxControlMessage",		5, 2, DEC),
+	F("bNumberFilters",		7, 1, DEC),
+	F("bMaxFilterSize",		8, 1, DEC),
+	F("wMaxSegmentSize",		9, 2, DEC),
+	F("bmNetworkCapabilities",	11, 1, HEX),
+};
+
+/* anything class specific that is not in the tables */
+static const struct descriptor_field class_fields[] = {
+	F("bDescriptorSubtype",		2, 1, DEC),
+	F("data",			3, 0, BYTES),
+};
+
+#define CS_INTERFACE	0x24
+#define CS_ENDPOINT	0x25
+
+/*
+ * Looked through in order, the first one that matches wins, so the catch
+ * all ones go last.
+ */
+static const struct descriptor_table class_descriptors[] = {
+	CLASS("HID Device Descriptor:", 0x21, 0x03, 3, hid_fields),
+	CLASS("Hub Descriptor:", 0x29, 0x09, 1, hub_fields),
+	CLASS("SuperSpeed Hub Descriptor:", 0x2a, 0x09, 1, ss_hub_fields),
+
+	SUBCLASS("AudioControl Interface Descriptor: HEADER",
+		 CS_INTERFACE, 0x01, 0x01, 0x01, audio_header_fields),
+	SUBCLASS("AudioControl Interface Descriptor: INPUT_TERMINAL",
+		 CS_INTERFACE, 0x01, 0x01, 0x02, audio_input_terminal_fields),
+	SUBCLASS("AudioControl Interface Descriptor: OUTPUT_TERMINAL",
+		 CS_INTERFACE, 0x01, 0x01, 0x03, audio_output_terminal_fields),
+	SUBCLASS("AudioControl Interface Descriptor: MIXER_UNIT",
+		 CS_INTERFACE, 0x01, 0x01, 0x04, audio_mixer_unit_fields),
+	SUBCLASS("AudioControl Interface Descriptor: SELECTOR_UNIT",
+		 CS_INTERFACE, 0x01, 0x01, 0x05, audio_selector_unit_fields),
+	SUBCLASS("AudioControl Interface Descriptor: FEATURE_UNIT",
+		 CS_INTERFACE, 0x01, 0x01, 0x06, audio_feature_unit_fields),
+	SUBCLASS("AudioStreaming Interface Descriptor: AS_GENERAL",
+		 CS_INTERFACE, 0x01, 0x02, 0x01, audio_streaming_fields),
+	SUBCLASS("AudioStreaming Interface Descriptor: FORMAT_TYPE",
+		 CS_INTERFACE, 0x01, 0x02, 0x02, audio_format_fields),
+	SUBTYPE("AudioStreaming Endpoint Descriptor: EP_GENERAL",
+		CS_ENDPOINT, 0x01, 0x01, audio_endpoint_fields),
+
+	SUBCLASS("VideoControl Interface Descriptor: VC_HEADER",
+		 CS_INTERFACE, 0x0e, 0x01, 0x01, video_header_fields),
+	SUBCLASS("VideoControl Interface Descriptor: VC_INPUT_TERMINAL",
+		 CS_INTERFACE, 0x0e, 0x01, 0x02, video_input_terminal_fields),
+	SUBCLASS("VideoControl Interface Descriptor: VC_OUTPUT_TERMINAL",
+		 CS_INTERFACE, 0x0e, 0x01, 0x03, video_output_terminal_fields),
+	SUBCLASS("VideoControl Interface Descriptor: VC_SELECTOR_UNIT",
+		 CS_INTERFACE, 0x0e, 0x01, 0x04, video_selector_unit_fields),
+	SUBCLASS("VideoControl Interface Descriptor: VC_PROCESSING_UNIT",
+		 CS_INTERFACE, 0x0e, 0x01, 0x05, video_processing_unit_fields),
+	SUBCLASS("VideoControl Interface Descriptor: VC_EXTENSION_UNIT",
+		 CS_INTERFACE, 0x0e, 0x01, 0x06, video_extension_unit_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_INPUT_HEADER",
+		 CS_INTERFACE, 0x0e, 0x02, 0x01, video_input_header_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_STILL_IMAGE_FRAME",
+		 CS_INTERFACE, 0x0e, 0x02, 0x03, video_still_frame_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_FORMAT_UNCOMPRESSED",
+		 CS_INTERFACE, 0x0e, 0x02, 0x04, video_format_uncompressed_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_FRAME_UNCOMPRESSED",
+		 CS_INTERFACE, 0x0e, 0x02, 0x05, video_frame_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_FORMAT_MJPEG",
+		 CS_INTERFACE, 0x0e, 0x02, 0x06, video_format_mjpeg_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_FRAME_MJPEG",
+		 CS_INTERFACE, 0x0e, 0x02, 0x07, video_frame_fields),
+	SUBCLASS("VideoStreaming Interface Descriptor: VS_COLORFORMAT",
+		 CS_INTERFACE, 0x0e, 0x02, 0x0d, video_color_format_fields),
+	SUBTYPE("VideoControl Endpoint Descriptor: EP_INTERRUPT",
+		CS_ENDPOINT, 0x0e, 0x03, video_endpoint_fields),
+
+	SUBTYPE("CDC Header:", CS_INTERFACE, 0x02, 0x00, cdc_header_fields),
+	SUBTYPE("CDC Call Management:", CS_INTERFACE, 0x02, 0x01,
+		cdc_call_management_fields),
+	SUBTYPE("CDC ACM:", CS_INTERFACE, 0x02, 0x02, cdc_acm_fields),
+	SUBTYPE("CDC Union:", CS_INTERFACE, 0x02, 0x06, cdc_union_fields),
+	SUBTYPE("CDC Country:", CS_INTERFACE, 0x02, 0x07, cdc_country_fields),
+	SUBTYPE("CDC Ethernet:", CS_INTERFACE, 0x02, 0x0f, cdc_ethernet_fields),
+	SUBTYPE("CDC NCM:", CS_INTERFACE, 0x02, 0x1a, cdc_ncm_fields),
+	SUBTYPE("CDC MBIM:", CS_INTERFACE, 0x02, 0x1b, cdc_mbim_fields),
+
+	STANDARD("Class Specific Interface Descriptor:", CS_INTERFACE, 3,
+		 class_fields),
+	STANDARD("Class Specific Endpoint Descriptor:", CS_ENDPOINT, 3,
+		 class_fields),
+};
+
+static const struct descriptor_table unknown_descriptor =
+	STANDARD("Unknown Descriptor:", 0x00, 3, unknown_fields);
+
+/* what the descriptors so far say about the ones still to come */
+struct decode_state {
+	unsigned char class;		/* of the last interface */
+	unsigned char subclass;
+	unsigned char power_unit;	/* in mA, see USB_POWER_UNIT() */
+};
+
+static const struct descriptor_table *find_descriptor_table(const struct decode_state *state,
+							    const unsigned char *descriptor)
+{
+	const struct descriptor_table *table;
+	unsigned int i;
+
+	if (descriptor[1] < ARRAY_SIZE(standard_descriptors)) {
+		table = &standard_descriptors[descriptor[1]];
+		if (table->title)
+			return table;
+	}
+	for (i = 0; i < ARRAY_SIZE(class_descriptors); i++) {
+		table = &class_descriptors[i];
+		if (table->type != descriptor[1])
+			continue;
+		if ((table->match & MATCH_CLASS) && table->class != state->class)
+			continue;
+		if ((table->match & MATCH_SUBCLASS) &&
+		    table->subclass != state->subclass)
+			continue;
+		if ((table->match & MATCH_SUBTYPE) &&
+		    (descriptor[0] < 3 || table->subtype != descriptor[2]))
+			continue;
+		return table;
+	}
+	return &unknown_descriptor;
+}
+
+static void decode_indent(struct outbuf *out, unsigned int depth)
+{
+	static const char spaces[] = "                ";
+
+	out_mem(out, spaces, depth * 2 < sizeof(spaces) - 1 ?
+		depth * 2 : sizeof(spaces) - 1);
+}
+
+/* ' ' and two hex digits for each byte */
+static void decode_bytes(struct outbuf *out, const unsigned char *data, size_t size)
+{
+	while (size--) {
+		out_char(out, ' ');
+		out_hex(out, *data++, 2);
+	}
+}
+
+/*
+ * The number is right aligned to column 25 past the indent, the way the
+ * name and the value line up in every lsusb -v that came before this one.
+ */
+#define DECODE_COLUMN	25
+
+static unsigned int digits(unsigned long value, unsigned int base)
+{
+	unsigned int n = 1;
+
+	while (value >= base) {
+		value /= base;
+		n++;
+	}
+	return n;
+}
+
+static void decode_field(struct outbuf *out, const struct decode_state *state,
+			 const struct descriptor_field *field,
+			 const unsigned char *descriptor, unsigned int depth)
+{
+	static const char *const transfer_types[] = {
+		"Control", "Isochronous", "Bulk", "Interrupt",
+	};
+	const unsigned char *data = descriptor + field->offset;
+	unsigned int width = field->width;
+	unsigned long value = 0;
+	unsigned int length;
+	unsigned int name_length;
+	unsigned int i;
+
+	/* whatever the descriptor is too short for is not there */
+	if (field->offset + width > descriptor[0])
+		return;
+	if (width == 0) {
+		width = descriptor[0] - field->offset;
+		if (width == 0)
+			return;
+	}
+	for (i = 0; i < width && i < sizeof(value); i++)
+		value |= (unsigned long)data[i] << (8 * i);
+
+	switch (field->format) {
+	case FIELD_HEX:
+		length = 2 + 2 * width;
+		break;
+	case FIELD_BCD:
+		length = digits(value >> 8, 16) + 3;
+		break;
+	case FIELD_ENDPOINT:
+		length = 4;
+		break;
+	case FIELD_BYTES:
+		length = 3 * width - 1;
+		break;
+	default:
+		length = digits(value, 10);
+		break;
+	}
+
+	decode_indent(out, depth + 1);
+	out_str(out, field->name);
+	name_length = strlen(field->name);
+	out_char(out, ' ');
+	for (i = name_length + length + 1; i < DECODE_COLUMN; i++)
+		out_char(out, ' ');
+
+	switch (field->format) {
+	case FIELD_HEX:
+		out_mem(out, "0x", 2);
+		out_hex(out, value, 2 * width);
+		break;
+	case FIELD_BCD:
+		out_hex(out, value >> 8, 1);
+		out_char(out, '.');
+		out_hex(out, value & 0xff, 2);
+		break;
+	case FIELD_ENDPOINT:
+		out_mem(out, "0x", 2);
+		out_hex(out, value, 2);
+		out_mem(out, "  EP ", 5);
+		out_dec(out, value & 0x0f, 0);
+		out_str(out, value & 0x80 ? " IN" : " OUT");
+		break;
+	case FIELD_TRANSFER:
+		out_dec(out, value, 0);
+		out_mem(out, "  ", 2);
+		out_str(out, transfer_types[value & 0x03]);
+		break;
+	case FIELD_POWER:
+		out_dec(out, value, 0);
+		out_mem(out, "  ", 2);
+		out_dec(out, value * state->power_unit, 0);
+		out_mem(out, "mA", 2);
+		break;
+	case FIELD_BYTES:
+		out_hex(out, data[0], 2);
+		decode_bytes(out, data + 1, width - 1);
+		break;
+	default:
+		out_dec(out, value, 0);
+		break;
+	}
+	out_char(out, '\n');
+}
+
+static void decode_descriptor(struct outbuf *out, const struct decode_state *state,
+			      const struct descriptor_table *table,
+			      const unsigned char *descriptor)
+{
+	const struct descriptor_field *field;
+	const struct descriptor_field *end = table->fields + table->nfields;
+	unsigned int covered = 2;
+
+	decode_indent(out, table->depth);
+	out_str(out, table->title);
+	out_char(out, '\n');
+	for (field = header_fields; field < header_fields + 2; field++)
+		decode_field(out, state, field, descriptor, table->depth);
+	for (field = table->fields; field < end; field++) {
+		decode_field(out, state, field, descriptor, table->depth);
+		if (field->width == 0)
+			covered = descriptor[0];
+		else if (field->offset + field->width > covered)
+			covered = field->offset + field->width;
+	}
+
+	/* a descriptor longer than it should be, show the rest of it anyway */
+	if (covered < descriptor[0]) {
+		decode_indent(out, table->depth + 1);
+		out_mem(out, "** extra", 8);
+		decode_bytes(out, descriptor + covered, descriptor[0] - covered);
+		out_char(out, '\n');
+	}
+}
+
+/*
+ * Every descriptor in @data, and if the last one is cut short (or the
+ * lengths don't add up) what is left of it as plain bytes.  @speed is what
+ * the device runs at, which MaxPower depends on.
+ */
+void decode_usb_descriptors(struct outbuf *out, const unsigned char *data,
+			    size_t size, u32 speed)
+{
+	struct decode_state state = {
+		.power_unit	= USB_POWER_UNIT(speed),
+	};
+	const struct descriptor_table *table;
+	const unsigned char *descriptor;
+	size_t offset = 0;
+
+	while (size - offset >= 2) {
+		descriptor = data + offset;
+		if (descriptor[0] < 2 || descriptor[0] > size - offset)
+			break;
+
+		table = find_descriptor_table(&state, descriptor);
+		switch (descriptor[1]) {
+		case 0x04:
+			if (descriptor[0] >= 7) {
+				state.class = descriptor[5];
+				state.subclass = descriptor[6];
+			}
+			break;
+		}
+		decode_descriptor(out, &state, table, descriptor);
+		offset += descriptor[0];
+	}
+
+	if (offset < size) {
+		out_mem(out, "** junk at the end:", 19);
+		decode_bytes(out, data + offset, size - offset);
+		out_char(out, '\n');
+	}
+}
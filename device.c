@@ -27,211 +27,770 @@
 #include <sys/select.h>
 #include <sys/stat.h>
 
-#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
-
-#include <libudev.h>
 #include "list.h"
 #include "usb.h"
 #include "lsusb.h"
+#include "arena.h"
 
 
 
-static LIST_HEAD(usb_devices);
-
 static struct usb_device *new_usb_device(void)
 {
 	return robust_malloc(sizeof(struct usb_device));
 }
 
-static void free_usb_device(struct usb_device *usb_device)
-{
-	free(usb_device->idVendor);
-	free(usb_device->idProduct);
-	free(usb_device->busnum);
-	free(usb_device->devnum);
-	free(usb_device->manufacturer);
-	free(usb_device->bcdDevice);
-	free(usb_device->product);
-	free(usb_device->serial);
-	free(usb_device->bConfigurationValue);
-	free(usb_device->bDeviceClass);
-	free(usb_device->bDeviceProtocol);
-	free(usb_device->bDeviceSubClass);
-	free(usb_device->bNumConfigurations);
-	free(usb_device->bNumInterfaces);
-	free(usb_device->bmAttributes);
-	free(usb_device->bMaxPacketSize0);
-	free(usb_device->bMaxPower);
-	free(usb_device->maxchild);
-	free(usb_device->quirks);
-	free(usb_device->speed);
-	free(usb_device->version);
-	free(usb_device->driver);
-	free_usb_endpoint(usb_device->ep0);
-	free(usb_device);
-}
-
-void free_usb_devices(void)
+/*
+ * Devices are kept on the list of a struct lsusb_snapshot, and also hashed
+ * by their sysfs name, so a hotplug event can find the device it is about
+ * without walking the whole list.
+ */
+static unsigned int hash_sysname(const char *name)
+{
+	unsigned int hash = 0;
+
+	while (name && *name)
+		hash = hash * 31 + (unsigned char)*name++;
+	return hash % USB_DEVICE_HASH_SIZE;
+}
+
+struct usb_device *find_usb_device(struct lsusb_snapshot *snapshot,
+				   const char *sysname)
 {
 	struct usb_device *usb_device;
-	struct usb_interface *usb_interface;
-	struct usb_endpoint *usb_endpoint;
-	struct usb_device *temp_usb;
-	struct usb_interface *temp_intf;
-	struct usb_endpoint *temp_endpoint;
-
-	list_for_each_entry_safe(usb_device, temp_usb, &usb_devices, list) {
-		list_del(&usb_device->list);
-		list_for_each_entry_safe(usb_interface, temp_intf, &usb_device->interfaces, list) {
-			list_del(&usb_interface->list);
-			list_for_each_entry_safe(usb_endpoint, temp_endpoint, &usb_interface->endpoints, list) {
-				list_del(&usb_endpoint->list);
-				free_usb_endpoint(usb_endpoint);
-			}
-			free_usb_interface(usb_interface);
+
+	usb_device = snapshot->hash[hash_sysname(sysname)];
+	for (; usb_device; usb_device = usb_device->hash_next)
+		if (usb_device->sysname && strcmp(usb_device->sysname, sysname) == 0)
+			return usb_device;
+	return NULL;
+}
+
+static void unhash_usb_device(struct lsusb_snapshot *snapshot,
+			      struct usb_device *usb_device)
+{
+	struct usb_device **pos;
+
+	pos = &snapshot->hash[hash_sysname(usb_device->sysname)];
+	for (; *pos; pos = &(*pos)->hash_next) {
+		if (*pos == usb_device) {
+			*pos = usb_device->hash_next;
+			return;
+		}
+	}
+}
+
+/*
+ * Take a device that went away off the list.  If it came in after the scan
+ * it has an arena of its own, and everything about it goes with that, and so
+ * do any interfaces that came in after it did.
+ */
+void remove_usb_device(struct lsusb_snapshot *snapshot,
+		       struct usb_device *usb_device)
+{
+	struct arena *arena = usb_device->arena;
+	struct usb_interface *usb_intf;
+	struct usb_interface *temp;
+
+	list_del(&usb_device->list);
+	unhash_usb_device(snapshot, usb_device);
+	list_for_each_entry_safe(usb_intf, temp, &usb_device->interfaces, list)
+		if (usb_intf->arena)
+			remove_usb_interface(usb_intf);
+	if (arena) {
+		arena_release(arena);
+		free(arena);
+	}
+}
+
+/*
+ * All devices, interfaces, endpoints and their strings come out of the
+ * arena of the snapshot, so tearing everything down is just dropping the
+ * arena (and those of anything hotplugged).
+ */
+void free_usb_devices(struct lsusb_snapshot *snapshot)
+{
+	struct usb_device *usb_device;
+	struct usb_device *temp;
+
+	list_for_each_entry_safe(usb_device, temp, &snapshot->devices, list)
+		remove_usb_device(snapshot, usb_device);
+	INIT_LIST_HEAD(&snapshot->devices);
+	memset(snapshot->hash, 0, sizeof(snapshot->hash));
+	arena_release(snapshot->arena);
+}
+
+/*
+ * Turn the sysfs name of a device ("usb2", "2-1", "2-1.4.3", ...) into a
+ * key that sorts by bus and then by port at each tier of the tree.  There can
+ * only be 6 ports in the chain below a root hub, so one byte each fits.
+ */
+static u64 topology_key(const struct usb_device *usb_device)
+{
+	const char *name = usb_device->sysname;
+	u64 key = (u64)usb_device->busnum << 48;
+	int shift = 40;
+	char *end;
+
+	if (name == NULL || strncmp(name, "usb", 3) == 0)
+		return key;
+	name = strchr(name, '-');
+	while (name != NULL && shift >= 0) {
+		key |= (u64)(strtoul(name + 1, &end, 10) & 0xff) << shift;
+		shift -= 8;
+		name = (*end == '.') ? end : NULL;
+	}
+	return key;
+}
+
+static u64 sort_key(const struct usb_device *usb_device, enum usb_sort_key key)
+{
+	switch (key) {
+	case SORT_ID:
+		return ((u64)usb_device->idVendor << 48) |
+		       ((u64)usb_device->idProduct << 32) |
+		       ((u64)usb_device->busnum << 16) |
+		       usb_device->devnum;
+	case SORT_PATH:
+		return topology_key(usb_device);
+	case SORT_BUSDEV:
+	default:
+		return ((u64)usb_device->busnum << 16) | usb_device->devnum;
+	}
+}
+
+static const char * const sort_key_names[] = {
+	[SORT_BUSDEV]	= "busdev",
+	[SORT_ID]	= "id",
+	[SORT_PATH]	= "path",
+};
+
+int parse_usb_sort_key(const char *name, enum usb_sort_key *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sort_key_names); i++) {
+		if (strcmp(name, sort_key_names[i]) == 0) {
+			*key = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *usb_sort_key_name(enum usb_sort_key key)
+{
+	return sort_key_names[key];
+}
+
+#define sort_key_of(entry)	(list_entry(entry, struct usb_device, list)->sort_key)
+
+/*
+ * Merge two NULL terminated, sorted lists.  Everything in @a was on the list
+ * before everything in @b, so taking from @a on ties keeps the sort stable.
+ */
+static struct list_head *merge_usb_devices(struct list_head *a, struct list_head *b)
+{
+	struct list_head head;
+	struct list_head *tail = &head;
+
+	while (a && b) {
+		if (sort_key_of(a) <= sort_key_of(b)) {
+			tail->next = a;
+			a = a->next;
+		} else {
+			tail->next = b;
+			b = b->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = a ? a : b;
+	return head.next;
+}
+
+/*
+ * Bottom up merge sort of the device list, the same way the kernel's
+ * list_sort() works.  The key for each device is worked out once up front so
+ * the merge passes only ever compare two integers.
+ */
+void sort_usb_devices(struct lsusb_snapshot *snapshot, enum usb_sort_key key)
+{
+	struct list_head *head = &snapshot->devices;
+	struct list_head *part[33];	/* sorted partial lists, 2^n long */
+	struct usb_device *usb_device;
+	struct list_head *list;
+	struct list_head *prev;
+	int max_lev = 0;
+	int lev;
+
+	if (list_empty(head))
+		return;
+
+	list_for_each_entry(usb_device, head, list)
+		usb_device->sort_key = sort_key(usb_device, key);
+
+	memset(part, 0, sizeof(part));
+	head->prev->next = NULL;
+	list = head->next;
+	while (list) {
+		struct list_head *cur = list;
+
+		list = list->next;
+		cur->next = NULL;
+		for (lev = 0; part[lev]; lev++) {
+			cur = merge_usb_devices(part[lev], cur);
+			part[lev] = NULL;
 		}
-		free_usb_device(usb_device);
+		if (lev > max_lev)
+			max_lev = lev;
+		part[lev] = cur;
 	}
+
+	list = NULL;
+	for (lev = 0; lev <= max_lev; lev++)
+		if (part[lev])
+			list = merge_usb_devices(part[lev], list);
+
+	/* put the prev pointers and the list head back together */
+	prev = head;
+	for (; list; list = list->next) {
+		prev->next = list;
+		list->prev = prev;
+		prev = list;
+	}
+	prev->next = head;
+	head->prev = prev;
 }
 
-static int compare_usb_devices(struct usb_device *a, struct usb_device *b)
+/*
+ * Work out the topology from the sysfs names: the parent of "2-1.4.3" is
+ * "2-1.4", the parent of "2-1" is the root hub "usb2", and the port is the
+ * last number in the name.  Parents are looked up in the hash, so this is a
+ * pass over the list to reset the links and one to make them, no matter how
+ * deep the tree is.  Children are kept in port order, which only means
+ * looking at the few that are on the same hub already.
+ *
+ * The links are only good until the list changes, so link again before
+ * walking the tree.  A device whose parent is not on the list (the scan
+ * was filtered, or it went away) is left at the top, like a root hub.
+ */
+static int parent_sysname(const struct usb_device *usb_device,
+			  char *name, size_t size, u8 *portnum)
 {
-	long busnum_a = strtol(a->busnum, NULL, 10);
-	long busnum_b = strtol(b->busnum, NULL, 10);
-	long devnum_a;
-	long devnum_b;
+	const char *sysname = usb_device->sysname;
+	const char *dot;
+	const char *dash;
 
-	if (busnum_a < busnum_b)
+	*portnum = 1;
+	if (sysname == NULL || strncmp(sysname, "usb", 3) == 0)
 		return -1;
-	if (busnum_a > busnum_b)
-		return 1;
-	devnum_a = strtol(a->devnum, NULL, 10);
-	devnum_b = strtol(b->devnum, NULL, 10);
-	if (devnum_a < devnum_b)
+	dash = strchr(sysname, '-');
+	if (dash == NULL)
 		return -1;
-	if (devnum_a > devnum_b)
-		return 1;
+	dot = strrchr(dash, '.');
+	if (dot) {
+		*portnum = strtoul(dot + 1, NULL, 10);
+		snprintf(name, size, "%.*s", (int)(dot - sysname), sysname);
+	} else {
+		*portnum = strtoul(dash + 1, NULL, 10);
+		snprintf(name, size, "usb%.*s", (int)(dash - sysname), sysname);
+	}
 	return 0;
 }
 
-void sort_usb_devices(void)
+void link_usb_devices(struct lsusb_snapshot *snapshot)
 {
-	LIST_HEAD(sorted_devices);
-	struct usb_device *sorted_usb_device;
 	struct usb_device *usb_device;
-	struct usb_device *temp;
-	int moved;
+	struct usb_device *parent;
+	struct usb_device *child;
+	struct list_head *pos;
+	char name[64];
 
-	list_for_each_entry_safe(usb_device, temp, &usb_devices, list) {
-		/* is this the first item to add to the list? */
-		if (list_empty(&sorted_devices)) {
-			list_move_tail(&usb_device->list, &sorted_devices);
+	list_for_each_entry(usb_device, &snapshot->devices, list) {
+		usb_device->parent = NULL;
+		INIT_LIST_HEAD(&usb_device->children);
+	}
+	list_for_each_entry(usb_device, &snapshot->devices, list) {
+		if (parent_sysname(usb_device, name, sizeof(name),
+				   &usb_device->portnum))
 			continue;
-		}
-
-		/*
-		 * Not the first item, iterate over the sorted list and try
-		 * to find a place in it to put this device
-		 */
-		moved = 0;
-		list_for_each_entry(sorted_usb_device, &sorted_devices, list) {
-			if (compare_usb_devices(usb_device, sorted_usb_device) <= 0) {
-				/* add usb_device before sorted_usb_device */
-				list_del(&usb_device->list);
-				list_add_tail(&usb_device->list,
-					      &sorted_usb_device->list);
-				moved = 1;
+		parent = find_usb_device(snapshot, name);
+		if (parent == NULL)
+			continue;
+		usb_device->parent = parent;
+		/* in front of the first child on a higher port */
+		pos = &parent->children;
+		list_for_each_entry(child, &parent->children, sibling) {
+			if (child->portnum > usb_device->portnum) {
+				pos = &child->sibling;
 				break;
 			}
 		}
-		if (moved == 0) {
-			/*
-			 * Could not find a place in the list to add the
-			 * device, so add it to the end of the sorted_devices
-			 * list as that is where it belongs.
-			 */
-			list_move_tail(&usb_device->list, &sorted_devices);
+		list_add_tail(&usb_device->sibling, pos);
+	}
+}
+
+/*
+ * Filters, for the command line and for queries to the daemon.  Anything
+ * left at -1 matches every device.
+ */
+void init_usb_filter(struct usb_filter *filter)
+{
+	filter->busnum = -1;
+	filter->devnum = -1;
+	filter->idVendor = -1;
+	filter->idProduct = -1;
+	filter->class = -1;
+}
+
+/* a number up to @max, or -1 ("any") if there isn't one at @value */
+static int parse_filter_number(const char *value, char **end, int base, int max)
+{
+	unsigned long number;
+
+	if (!isxdigit((unsigned char)*value)) {
+		*end = (char *)value;
+		return -1;
+	}
+	number = strtoul(value, end, base);
+	return number > (unsigned long)max ? -2 : (int)number;
+}
+
+/*
+ * "bus N", "dev N", "id [vvvv][:[pppp]]", "slot [[bus]:][dev]" (that is
+ * lsusb -s) or "class CC".  The parts of id and slot that are left out mean
+ * any, but at least one has to be there.
+ */
+int parse_usb_filter(struct usb_filter *filter, const char *key, const char *value)
+{
+	int *first;
+	int *second;
+	char *end;
+	int base = 10;
+	int max = 0xffff;
+
+	if (strcmp(key, "bus") == 0) {
+		filter->busnum = parse_filter_number(value, &end, 10, max);
+		return (filter->busnum < 0 || *end != '\0') ? -1 : 0;
+	}
+	if (strcmp(key, "dev") == 0) {
+		filter->devnum = parse_filter_number(value, &end, 10, max);
+		return (filter->devnum < 0 || *end != '\0') ? -1 : 0;
+	}
+	if (strcmp(key, "class") == 0) {
+		filter->class = parse_filter_number(value, &end, 16, 0xff);
+		return (filter->class < 0 || *end != '\0') ? -1 : 0;
+	}
+
+	if (strcmp(key, "id") == 0) {
+		first = &filter->idVendor;
+		second = &filter->idProduct;
+		base = 16;
+	} else if (strcmp(key, "slot") == 0) {
+		first = &filter->busnum;
+		second = &filter->devnum;
+		/* just a number is the device number */
+		if (strchr(value, ':') == NULL) {
+			first = &filter->devnum;
+			second = NULL;
 		}
+	} else {
+		return -1;
+	}
+	*first = parse_filter_number(value, &end, base, max);
+	if (second && *end == ':')
+		*second = parse_filter_number(end + 1, &end, base, max);
+	if (*first < -1 || (second && *second < -1) || *end != '\0' ||
+	    (*first == -1 && (second == NULL || *second == -1))) {
+		*first = -1;
+		if (second)
+			*second = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/* The other way around, for handing a filter on to the daemon */
+void format_usb_filter(const struct usb_filter *filter, char *buf, size_t size)
+{
+	int len = 0;
+
+	buf[0] = '\0';
+	if (filter->busnum != -1)
+		len += snprintf(buf + len, size - len, " bus %d", filter->busnum);
+	if (filter->devnum != -1)
+		len += snprintf(buf + len, size - len, " dev %d", filter->devnum);
+	if (filter->idVendor != -1 && filter->idProduct != -1)
+		len += snprintf(buf + len, size - len, " id %04x:%04x",
+				filter->idVendor, filter->idProduct);
+	else if (filter->idVendor != -1)
+		len += snprintf(buf + len, size - len, " id %04x", filter->idVendor);
+	else if (filter->idProduct != -1)
+		len += snprintf(buf + len, size - len, " id :%04x", filter->idProduct);
+	if (filter->class != -1)
+		snprintf(buf + len, size - len, " class %02x", filter->class);
+}
+
+/* the class matches the device, or any of its interfaces */
+static int match_usb_class(struct usb_device *usb_device, int class)
+{
+	struct usb_interface *usb_interface;
+
+	load_usb_device(usb_device, USB_ATTR(DEVICE_CLASS));
+	if (usb_device->bDeviceClass == class)
+		return 1;
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list) {
+		load_usb_interface(usb_device, usb_interface,
+				   USB_ATTR(INTERFACE_CLASS));
+		if (usb_interface->bInterfaceClass == class)
+			return 1;
+	}
+	return 0;
+}
+
+int match_usb_device(const struct usb_filter *filter,
+		     struct usb_device *usb_device)
+{
+	if (filter == NULL)
+		return 1;
+	if (filter->busnum != -1 && usb_device->busnum != filter->busnum)
+		return 0;
+	if (filter->devnum != -1 && usb_device->devnum != filter->devnum)
+		return 0;
+	if (filter->idVendor != -1 && usb_device->idVendor != filter->idVendor)
+		return 0;
+	if (filter->idProduct != -1 && usb_device->idProduct != filter->idProduct)
+		return 0;
+	if (filter->class != -1 && !match_usb_class(usb_device, filter->class))
+		return 0;
+	return 1;
+}
+
+/*
+ * What to call a device: the vendor and product names usb.ids has for it, or
+ * what the device says about itself if usb.ids has never heard of the vendor,
+ * in which case @product is NULL.
+ */
+void usb_device_names(const struct usb_device *usb_device,
+		      const char **vendor, const char **product)
+{
+	*vendor = usb_vendor_name(usb_device->idVendor);
+	*product = NULL;
+	if (*vendor == NULL) {
+		*vendor = usb_device->manufacturer;
+		return;
 	}
-	/* usb_devices should be empty now, so just swap the lists over. */
-	list_splice(&sorted_devices, &usb_devices);
+	*product = usb_product_name(usb_device->idVendor, usb_device->idProduct);
+	if (*product == NULL)
+		*product = usb_device->product;
 }
 
-void print_usb_devices(void)
+void format_usb_devices(struct outbuf *out, struct lsusb_snapshot *snapshot,
+			const struct usb_filter *filter,
+			const struct usb_formatter *formatter)
 {
 	struct usb_device *usb_device;
+
+	if (formatter->begin)
+		formatter->begin(out, snapshot, filter);
+	list_for_each_entry(usb_device, &snapshot->devices, list)
+		if (match_usb_device(filter, usb_device))
+			formatter->device(out, usb_device);
+	if (formatter->end)
+		formatter->end(out);
+}
+
+void print_usb_devices(struct lsusb_snapshot *snapshot, int fd,
+		       const struct usb_filter *filter,
+		       const struct usb_formatter *formatter)
+{
+	struct outbuf out;
+
+	out_init(&out, fd);
+	format_usb_devices(&out, snapshot, filter, formatter);
+	out_flush(&out);
+}
+
+static const struct dev_attr usb_device_attrs[] = {
+	[DEVICE_MANUFACTURER]		= DEV_ATTR(struct usb_device, manufacturer, ATTR_INTERN),
+	[DEVICE_PRODUCT]		= DEV_ATTR(struct usb_device, product, ATTR_INTERN),
+	[DEVICE_SERIAL]			= DEV_ATTR(struct usb_device, serial, ATTR_STRING),
+	[DEVICE_BUSNUM]			= DEV_ATTR(struct usb_device, busnum, ATTR_DEC),
+	[DEVICE_DEVNUM]			= DEV_ATTR(struct usb_device, devnum, ATTR_DEC),
+	[DEVICE_IDVENDOR]		= DEV_ATTR(struct usb_device, idVendor, ATTR_HEX),
+	[DEVICE_IDPRODUCT]		= DEV_ATTR(struct usb_device, idProduct, ATTR_HEX),
+	[DEVICE_BCDDEVICE]		= DEV_ATTR(struct usb_device, bcdDevice, ATTR_HEX),
+	[DEVICE_CONFIGURATION_VALUE]	= DEV_ATTR(struct usb_device, bConfigurationValue, ATTR_DEC),
+	[DEVICE_CLASS]			= DEV_ATTR(struct usb_device, bDeviceClass, ATTR_HEX),
+	[DEVICE_PROTOCOL]		= DEV_ATTR(struct usb_device, bDeviceProtocol, ATTR_HEX),
+	[DEVICE_SUBCLASS]		= DEV_ATTR(struct usb_device, bDeviceSubClass, ATTR_HEX),
+	[DEVICE_NUM_CONFIGURATIONS]	= DEV_ATTR(struct usb_device, bNumConfigurations, ATTR_DEC),
+	[DEVICE_NUM_INTERFACES]		= DEV_ATTR(struct usb_device, bNumInterfaces, ATTR_DEC),
+	[DEVICE_ATTRIBUTES]		= DEV_ATTR(struct usb_device, bmAttributes, ATTR_HEX),
+	[DEVICE_MAX_PACKET_SIZE0]	= DEV_ATTR(struct usb_device, bMaxPacketSize0, ATTR_DEC),
+	[DEVICE_MAX_POWER]		= DEV_ATTR(struct usb_device, bMaxPower, ATTR_DEC),
+	[DEVICE_MAXCHILD]		= DEV_ATTR(struct usb_device, maxchild, ATTR_DEC),
+	[DEVICE_QUIRKS]			= DEV_ATTR(struct usb_device, quirks, ATTR_HEX),
+	[DEVICE_SPEED]			= DEV_ATTR(struct usb_device, speed, ATTR_SPEED),
+	[DEVICE_VERSION]		= DEV_ATTR(struct usb_device, version, ATTR_BCD),
+};
+
+/*
+ * In descriptor mode everything else comes out of the "descriptors" file, so
+ * only read what is not in there.
+ */
+int descriptor_mode;
+
+#define USB_DEVICE_DESCRIPTOR_MODE (USB_ATTR(DEVICE_MANUFACTURER) |	\
+				 USB_ATTR(DEVICE_PRODUCT) |		\
+				 USB_ATTR(DEVICE_SERIAL) |		\
+				 USB_ATTR(DEVICE_BUSNUM) |		\
+				 USB_ATTR(DEVICE_DEVNUM) |		\
+				 USB_ATTR(DEVICE_CONFIGURATION_VALUE) |	\
+				 USB_ATTR(DEVICE_MAXCHILD) |		\
+				 USB_ATTR(DEVICE_SPEED))
+
+/*
+ * Building a device only reads the attributes that are wanted, which for the
+ * plain listing is just what it prints.  Anything else is read the first
+ * time something asks for it, with load_usb_device(), and from then on it is
+ * wanted from every device built after that one as well: if one device gets
+ * asked for its speed, the rest will be too.
+ */
+u32 usb_device_wanted = USB_DEVICE_LISTING;
+u32 usb_interface_wanted;
+
+/*
+ * Make sure everything in @mask has been read in.  The device is opened
+ * again by name, so this works any time after the scan, but it does nothing
+ * for what has been read already, and that is everything for a device that
+ * came out of a snapshot.
+ */
+void load_usb_device(struct usb_device *usb_device, u32 mask)
+{
+	struct sysfs_dev device;
+	struct arena *old = NULL;
+
+	mask &= ~usb_device->loaded;
+	if (mask == 0)
+		return;
+	__atomic_fetch_or(&usb_device_wanted, mask, __ATOMIC_RELAXED);
+	/* if it can't be read now, it is not going to work the next time */
+	usb_device->loaded |= mask;
+	if (open_usb_dev(usb_device->sysname, &device))
+		return;
+
+	if (usb_device->arena)
+		old = use_arena(usb_device->arena);
+	queue_dev_attr_set(&device, NULL, usb_device, usb_device_attrs,
+			   ARRAY_SIZE(usb_device_attrs), mask);
+	if (mask & USB_ATTR(DEVICE_EP0))
+		usb_device->ep0 = create_usb_endpoint(&device, "ep_00");
+	if (mask & USB_ATTR(DEVICE_DESCRIPTORS))
+		load_raw_usb_descriptor(&device, usb_device);
+	flush_dev_attrs();
+	if (old)
+		use_arena(old);
+	close_dev(&device);
+}
+
+/* everything there is, for the device and all of its interfaces */
+void load_usb_device_all(struct usb_device *usb_device)
+{
 	struct usb_interface *usb_interface;
-	struct usb_endpoint *usb_endpoint;
-
-	list_for_each_entry(usb_device, &usb_devices, list) {
-		printf("Bus %03ld Device %03ld: ID %s:%s %s\n",
-			strtol(usb_device->busnum, NULL, 10),
-			strtol(usb_device->devnum, NULL, 10),
-			usb_device->idVendor,
-			usb_device->idProduct,
-			usb_device->manufacturer);
-		list_for_each_entry(usb_interface, &usb_device->interfaces, list) {
-			printf("\tIntf %s (%s)\n",
-				usb_interface->sysname,
-				usb_interface->driver);
-//			list_for_each_entry(usb_endpoint, &usb_interface->endpoints, list) {
-//				printf("\t\tEp (%s)\n", usb_endpoint->bEndpointAddress);
-//			}
-		}
+
+	load_usb_device(usb_device, USB_ATTRS_ALL);
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+		load_usb_interface(usb_device, usb_interface, USB_ATTRS_ALL);
+}
+
+struct device_dir {
+	struct sysfs_dev *device;
+	struct usb_device *usb_device;
+};
+
+/*
+ * Sort out everything in the device's directory in one pass: endpoint 0 and
+ * the interfaces (which then pick up their own endpoints).
+ */
+static void add_device_entry(const char *name, unsigned char type, void *data)
+{
+	struct device_dir *dir = data;
+
+	if (type != DT_DIR)
+		return;
+	if (strcmp(name, "ep_00") == 0) {
+		if (dir->usb_device->loaded & USB_ATTR(DEVICE_EP0))
+			dir->usb_device->ep0 = create_usb_endpoint(dir->device, name);
+	} else if (is_usb_interface_name(name))
+		create_usb_interface(dir->device, name, dir->usb_device);
+}
+
+/* Add the device to the end of the list of @snapshot */
+void add_usb_device(struct lsusb_snapshot *snapshot, struct usb_device *usb_device)
+{
+	unsigned int hash = hash_sysname(usb_device->sysname);
+
+	list_add_tail(&usb_device->list, &snapshot->devices);
+	usb_device->hash_next = snapshot->hash[hash];
+	snapshot->hash[hash] = usb_device;
+}
+
+/* "usb2" and "2-1.4" are both on bus 2 */
+static int sysname_busnum(const char *name)
+{
+	char *end;
+	long busnum;
+
+	if (strncmp(name, "usb", 3) == 0)
+		name += 3;
+	busnum = strtol(name, &end, 10);
+	if (end == name || (*end != '\0' && *end != '-'))
+		return -1;
+	return busnum;
+}
+
+static int read_number_attr(struct sysfs_dev *device, const char *name, int base)
+{
+	char value[32];
+	const char *temp;
+	char *end;
+	long number;
+
+	temp = read_dev_attr(device, name, value, sizeof(value));
+	if (temp == NULL)
+		return -1;
+	number = strtol(temp, &end, base);
+	return end == temp ? -1 : number;
+}
+
+/*
+ * Can the device called @name (or at the end of the path @name) match
+ * @filter at all?  This only goes by the bus number in the name, so the scan
+ * does not even have to open the other devices.
+ */
+int usb_filter_may_match(const struct usb_filter *filter, const char *name)
+{
+	const char *slash = strrchr(name, '/');
+	int busnum;
+
+	if (filter == NULL || filter->busnum == -1)
+		return 1;
+	busnum = sysname_busnum(slash ? slash + 1 : name);
+	return busnum == -1 || busnum == filter->busnum;
+}
+
+/*
+ * Is there any point in building @device for @filter?  This is asked before
+ * anything else gets read, and only reads what it has to: the bus number is
+ * right there in the name, the others are one attribute each.  The class
+ * can't be known without the interfaces, so that is left for printing.
+ */
+static int filter_usb_device(struct sysfs_dev *device,
+			     const struct usb_filter *filter)
+{
+	int busnum;
+
+	if (filter->busnum != -1) {
+		busnum = sysname_busnum(get_dev_sysname(device));
+		if (busnum == -1)
+			busnum = read_number_attr(device, "busnum", 10);
+		if (busnum != filter->busnum)
+			return 0;
 	}
+	if (filter->devnum != -1 &&
+	    read_number_attr(device, "devnum", 10) != filter->devnum)
+		return 0;
+	if (filter->idVendor != -1 &&
+	    read_number_attr(device, "idVendor", 16) != filter->idVendor)
+		return 0;
+	if (filter->idProduct != -1 &&
+	    read_number_attr(device, "idProduct", 16) != filter->idProduct)
+		return 0;
+	return 1;
 }
 
-void create_usb_device(struct udev_device *device)
+/*
+ * Build up a device, its interfaces and endpoints, or return NULL if it
+ * does not match @filter (which can be NULL to take everything) or it is
+ * gone.  This only touches the device itself, so it is safe to call from
+ * more than one thread at once.
+ */
+struct usb_device *create_usb_device(struct sysfs_dev *device,
+				     const struct usb_filter *filter)
 {
-	char file[PATH_MAX];
+	char driver[NAME_MAX];
 	struct usb_device *usb_device;
+	struct device_dir dir;
+	unsigned long start;
 	const char *temp;
+	int retval;
+
+	if (filter && !filter_usb_device(device, filter))
+		return NULL;
 
 	/*
 	 * Create a device and populate it with what we can find in the sysfs
 	 * directory for the USB device.
 	 */
+	count_stat(STAT_DEVICES, 1);
 	usb_device = new_usb_device();
 	INIT_LIST_HEAD(&usb_device->interfaces);
-	usb_device->bcdDevice		= get_dev_string(device, "bcdDevice");
-	usb_device->product		= get_dev_string(device, "product");
-	usb_device->serial		= get_dev_string(device, "serial");
-	usb_device->manufacturer	= get_dev_string(device, "manufacturer");
-	usb_device->idProduct		= get_dev_string(device, "idProduct");
-	usb_device->idVendor		= get_dev_string(device, "idVendor");
-	usb_device->busnum		= get_dev_string(device, "busnum");
-	usb_device->devnum		= get_dev_string(device, "devnum");
-	usb_device->bConfigurationValue	= get_dev_string(device, "bConfigurationValue");
-	usb_device->bDeviceClass	= get_dev_string(device, "bDeviceClass");
-	usb_device->bDeviceProtocol	= get_dev_string(device, "bDeviceProtocol");
-	usb_device->bDeviceSubClass	= get_dev_string(device, "bDeviceSubClass");
-	usb_device->bNumConfigurations	= get_dev_string(device, "bNumConfigurations");
-	usb_device->bNumInterfaces	= get_dev_string(device, "bNumInterfaces");
-	usb_device->bmAttributes	= get_dev_string(device, "bmAttributes");
-	usb_device->bMaxPacketSize0	= get_dev_string(device, "bMaxPacketSize0");
-	usb_device->bMaxPower		= get_dev_string(device, "bMaxPower");
-	usb_device->maxchild		= get_dev_string(device, "maxchild");
-	usb_device->quirks		= get_dev_string(device, "quirks");
-	usb_device->speed		= get_dev_string(device, "speed");
-	usb_device->version		= get_dev_string(device, "version");
-	temp = udev_device_get_driver(device);
+	INIT_LIST_HEAD(&usb_device->configs);
+	usb_device->sysname		= robust_strdup(get_dev_sysname(device));
+	temp = get_dev_driver(device, driver, sizeof(driver));
 	if (temp)
-		usb_device->driver = strdup(temp);
+		usb_device->driver = robust_intern(temp);
+
+	if (descriptor_mode) {
+		/*
+		 * The parser marks off what it finds in the descriptors,
+		 * anything it does not is still read from sysfs on demand.
+		 */
+		usb_device->loaded = USB_DEVICE_DESCRIPTOR_MODE |
+			(__atomic_load_n(&usb_device_wanted, __ATOMIC_RELAXED) &
+			 USB_ATTR(DEVICE_DESCRIPTORS));
+		queue_dev_attr_set(device, NULL, usb_device, usb_device_attrs,
+				   ARRAY_SIZE(usb_device_attrs),
+				   USB_DEVICE_DESCRIPTOR_MODE);
+		flush_dev_attrs();
+		start = stat_timer_begin();
+		retval = read_raw_usb_descriptor(device, usb_device);
+		stat_timer_end(TIMER_DESCRIPTORS, start);
+		if (retval)
+			return NULL;
+		start = stat_timer_begin();
+		if (usb_device->loaded & USB_ATTR(DEVICE_MAX_PACKET_SIZE0)) {
+			usb_device->ep0 = create_usb_endpoint0(usb_device->bMaxPacketSize0);
+			usb_device->loaded |= USB_ATTR(DEVICE_EP0);
+		}
+		create_usb_interfaces_from_descriptors(device, usb_device);
+		stat_timer_end(TIMER_DIRECTORIES, start);
+		return usb_device;
+	}
 
-	/* Build up endpoint 0 information */
-	usb_device->ep0 = create_usb_endpoint(device, "ep_00");
+	usb_device->loaded = __atomic_load_n(&usb_device_wanted, __ATOMIC_RELAXED);
+	queue_dev_attr_set(device, NULL, usb_device, usb_device_attrs,
+			   ARRAY_SIZE(usb_device_attrs), usb_device->loaded);
 
 	/*
 	 * Read the raw descriptor to get some more information (endpoint info,
 	 * configurations, interfaces, etc.)
 	 */
-	sprintf(file, "%s/descriptors", udev_device_get_syspath(device));
-	read_raw_usb_descriptor(device, usb_device);
+	start = stat_timer_begin();
+	retval = read_raw_usb_descriptor(device, usb_device);
+	stat_timer_end(TIMER_DESCRIPTORS, start);
 
-	/* Add the device to the list of global devices in the system */
-	list_add_tail(&usb_device->list, &usb_devices);
+	/* Build up endpoint 0 information and find the interfaces */
+	dir.device = device;
+	dir.usb_device = usb_device;
+	start = stat_timer_begin();
+	if (retval == 0)
+		retval = read_dev_dir(device, add_device_entry, &dir);
+	stat_timer_end(TIMER_DIRECTORIES, start);
 
-	/* try to find the interfaces for this device */
-	create_usb_interface(device, usb_device);
-}
+	/* whatever is left of the device and endpoint 0 attributes */
+	flush_dev_attrs();
 
+	/* it went away while we were at it, what there is of it is garbage */
+	return retval ? NULL : usb_device;
+}
@@ -27,9 +27,6 @@
 #include <sys/select.h>
 #include <sys/stat.h>
 
-#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
-
-#include <libudev.h>
 #include "list.h"
 #include "usb.h"
 #include "lsusb.h"
@@ -41,36 +38,59 @@ static struct usb_endpoint *new_usb_endpoint(void)
 	return robust_malloc(sizeof(struct usb_endpoint));
 }
 
-void free_usb_endpoint(struct usb_endpoint *usb_endpoint)
+/* sysfs shows all of the endpoint attributes in hex */
+static const struct dev_attr usb_endpoint_attrs[] = {
+	DEV_ATTR(struct usb_endpoint, bEndpointAddress,	ATTR_HEX),
+	DEV_ATTR(struct usb_endpoint, bInterval,	ATTR_HEX),
+	DEV_ATTR(struct usb_endpoint, bLength,		ATTR_HEX),
+	DEV_ATTR(struct usb_endpoint, bmAttributes,	ATTR_HEX),
+	DEV_ATTR(struct usb_endpoint, wMaxPacketSize,	ATTR_HEX),
+};
+
+/*
+ * The attributes are only queued up here, they are filled in when the
+ * caller flushes them with flush_dev_attrs().
+ */
+struct usb_endpoint *create_usb_endpoint(struct sysfs_dev *device, const char *endpoint_name)
 {
-	free(usb_endpoint->bEndpointAddress);
-	free(usb_endpoint->bInterval);
-	free(usb_endpoint->bLength);
-	free(usb_endpoint->bmAttributes);
-	free(usb_endpoint->direction);
-	free(usb_endpoint->type);
-	free(usb_endpoint->wMaxPacketSize);
-	free(usb_endpoint);
+	struct usb_endpoint *ep;
+
+	ep = new_usb_endpoint();
+	queue_dev_attrs(device, endpoint_name, ep, usb_endpoint_attrs,
+			ARRAY_SIZE(usb_endpoint_attrs));
+	return ep;
 }
 
-struct usb_endpoint *create_usb_endpoint(struct udev_device *device, const char *endpoint_name)
+/* Endpoint 0 is not in the descriptors, but there isn't much to it */
+struct usb_endpoint *create_usb_endpoint0(u8 bMaxPacketSize0)
 {
 	struct usb_endpoint *ep;
-	char filename[PATH_MAX];
 
 	ep = new_usb_endpoint();
+	ep->bLength		= 7;
+	ep->wMaxPacketSize	= bMaxPacketSize0;
+	return ep;
+}
 
-#define get_endpoint_string(string)					\
-	sprintf(filename, "%s/"__stringify(string), endpoint_name);	\
-	ep->string = get_dev_string(device, filename);
+/*
+ * The "direction" and "type" sysfs files are just decoded versions of
+ * bEndpointAddress and bmAttributes, so work them out the same way the
+ * kernel does instead of storing the strings.
+ */
+const char *usb_endpoint_direction(const struct usb_endpoint *usb_endpoint)
+{
+	if ((usb_endpoint->bmAttributes & 0x03) == 0x00)
+		return "both";
+	if (usb_endpoint->bEndpointAddress & 0x80)
+		return "in";
+	return "out";
+}
 
-	get_endpoint_string(bEndpointAddress);
-	get_endpoint_string(bInterval);
-	get_endpoint_string(bLength);
-	get_endpoint_string(bmAttributes);
-	get_endpoint_string(direction);
-	get_endpoint_string(type);
-	get_endpoint_string(wMaxPacketSize);
+const char *usb_endpoint_type(const struct usb_endpoint *usb_endpoint)
+{
+	static const char *const types[] = {
+		"Control", "Isoc", "Bulk", "Interrupt",
+	};
 
-	return ep;
+	return types[usb_endpoint->bmAttributes & 0x03];
 }
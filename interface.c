@@ -27,12 +27,10 @@
 #include <sys/select.h>
 #include <sys/stat.h>
 
-#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
-
-#include <libudev.h>
 #include "list.h"
 #include "usb.h"
 #include "lsusb.h"
+#include "arena.h"
 
 
 
@@ -41,104 +39,209 @@ static struct usb_interface *new_usb_interface(void)
 	return robust_malloc(sizeof(struct usb_interface));
 }
 
-void free_usb_interface(struct usb_interface *usb_intf)
+struct interface_dir {
+	struct sysfs_dev *interface;
+	struct usb_interface *usb_intf;
+};
+
+static void add_interface_endpoint(const char *name, unsigned char type, void *data)
 {
-	free(usb_intf->driver);
-	free(usb_intf->sysname);
-	free(usb_intf->bAlternateSetting);
-	free(usb_intf->bInterfaceClass);
-	free(usb_intf->bInterfaceNumber);
-	free(usb_intf->bInterfaceProtocol);
-	free(usb_intf->bInterfaceSubClass);
-	free(usb_intf->bNumEndpoints);
-	free(usb_intf);
+	struct interface_dir *dir = data;
+	struct usb_endpoint *ep;
+
+	if (type != DT_DIR)
+		return;
+	/* endpoints all start with "ep_" */
+	if ((name[0] != 'e') ||
+	    (name[1] != 'p') ||
+	    (name[2] != '_'))
+		return;
+	ep = create_usb_endpoint(dir->interface, name);
+
+	list_add_tail(&ep->list, &dir->usb_intf->endpoints);
 }
 
-static void create_usb_interface_endpoints(struct udev_device *device, struct usb_interface *usb_intf)
+static const struct dev_attr usb_interface_attrs[] = {
+	[INTERFACE_ALTERNATE_SETTING]	= DEV_ATTR(struct usb_interface, bAlternateSetting, ATTR_DEC),
+	[INTERFACE_CLASS]		= DEV_ATTR(struct usb_interface, bInterfaceClass, ATTR_HEX),
+	[INTERFACE_NUMBER]		= DEV_ATTR(struct usb_interface, bInterfaceNumber, ATTR_HEX),
+	[INTERFACE_PROTOCOL]		= DEV_ATTR(struct usb_interface, bInterfaceProtocol, ATTR_HEX),
+	[INTERFACE_SUBCLASS]		= DEV_ATTR(struct usb_interface, bInterfaceSubClass, ATTR_HEX),
+	[INTERFACE_NUM_ENDPOINTS]	= DEV_ATTR(struct usb_interface, bNumEndpoints, ATTR_HEX),
+};
+
+/* queue up reading whatever of @mask is not there yet */
+static void queue_usb_interface(struct sysfs_dev *interface,
+				struct usb_interface *usb_intf, u32 mask)
 {
-	struct usb_endpoint *ep;
-	struct dirent *dirent;
-	DIR *dir;
-
-	dir = opendir(udev_device_get_syspath(device));
-	if (dir == NULL)
-		exit(1);
-	while ((dirent = readdir(dir)) != NULL) {
-		if (dirent->d_type != DT_DIR)
-			continue;
-		/* endpoints all start with "ep_" */
-		if ((dirent->d_name[0] != 'e') ||
-		    (dirent->d_name[1] != 'p') ||
-		    (dirent->d_name[2] != '_'))
-			continue;
-		ep = create_usb_endpoint(device, dirent->d_name);
+	struct interface_dir dir;
+
+	queue_dev_attr_set(interface, NULL, usb_intf, usb_interface_attrs,
+			   ARRAY_SIZE(usb_interface_attrs), mask);
+	usb_intf->loaded |= mask;
 
-		list_add_tail(&ep->list, &usb_intf->endpoints);
+	/* find all endpoints for this interface, and save them */
+	if (mask & USB_ATTR(INTERFACE_ENDPOINTS)) {
+		dir.interface = interface;
+		dir.usb_intf = usb_intf;
+		read_dev_dir(interface, add_interface_endpoint, &dir);
 	}
-	closedir(dir);
+}
 
+/*
+ * The interface version of load_usb_device(), with what is wanted from them
+ * in usb_interface_wanted.  The plain listing wants nothing but the name and
+ * the driver, so by default the interface directories are not even opened.
+ */
+void load_usb_interface(struct usb_device *usb_device,
+			struct usb_interface *usb_intf, u32 mask)
+{
+	struct sysfs_dev interface;
+	struct arena *old = NULL;
+
+	mask &= ~usb_intf->loaded;
+	if (mask == 0)
+		return;
+	__atomic_fetch_or(&usb_interface_wanted, mask, __ATOMIC_RELAXED);
+	usb_intf->loaded |= mask;
+	if (open_usb_dev(usb_intf->sysname, &interface))
+		return;
+
+	if (usb_intf->arena)
+		old = use_arena(usb_intf->arena);
+	else if (usb_device->arena)
+		old = use_arena(usb_device->arena);
+	queue_usb_interface(&interface, usb_intf, mask);
+	flush_dev_attrs();
+	if (old)
+		use_arena(old);
+	close_dev(&interface);
+}
+
+/*
+ * Interfaces are named "bus-port[.port...]:config.interface", which is the
+ * only thing in a device's directory that starts with a digit and has a ':'
+ * in it (child devices start with a digit too, but have no ':').  So there
+ * is no need to go poke for a bInterfaceClass file to tell them apart.
+ */
+int is_usb_interface_name(const char *name)
+{
+	return isdigit(name[0]) && strchr(name, ':') != NULL;
 }
 
-void create_usb_interface(struct udev_device *device, struct usb_device *usb_device)
+/*
+ * Build up the interface @interface is the sysfs directory of, with all of
+ * its endpoints, and add it to @usb_device.
+ */
+struct usb_interface *build_usb_interface(struct sysfs_dev *interface,
+					  struct usb_device *usb_device)
 {
 	struct usb_interface *usb_intf;
-	struct udev_device *interface;
 	const char *driver_name;
-	int temp_file;
-	struct dirent *dirent;
-	char file[PATH_MAX];
-	DIR *dir;
-
-	dir = opendir(udev_device_get_syspath(device));
-	if (dir == NULL)
-		exit(1);
-	while ((dirent = readdir(dir)) != NULL) {
-		if (dirent->d_type != DT_DIR)
-			continue;
-		/*
-		 * As the devnum isn't in older kernels, we need to guess to
-		 * try to find the interfaces.
-		 *
-		 * If the first char is a digit, and bInterfaceClass is in the
-		 * subdir, then odds are it's a child interface
-		 */
-		if (!isdigit(dirent->d_name[0]))
-			continue;
+	char driver[NAME_MAX];
+
+	usb_intf = new_usb_interface();
+	INIT_LIST_HEAD(&usb_intf->config_list);
+	INIT_LIST_HEAD(&usb_intf->endpoints);
+	usb_intf->sysname		= robust_strdup(get_dev_sysname(interface));
+
+	driver_name = get_dev_driver(interface, driver, sizeof(driver));
+	if (driver_name)
+		usb_intf->driver = robust_intern(driver_name);
+	list_add_tail(&usb_intf->list, &usb_device->interfaces);
+
+	/* read the interface and all of its endpoints in one batch */
+	queue_usb_interface(interface, usb_intf,
+			    __atomic_load_n(&usb_interface_wanted, __ATOMIC_RELAXED));
+	flush_dev_attrs();
+	return usb_intf;
+}
 
-		sprintf(file, "%s/%s/bInterfaceClass",
-			udev_device_get_syspath(device), dirent->d_name);
-		temp_file = open(file, O_RDONLY);
-		if (temp_file == -1)
-			continue;
+/*
+ * Take an interface that went away off its device.  If it came in after the
+ * device did it has an arena of its own, and everything about it goes with
+ * that, otherwise it goes when the device does.
+ */
+void remove_usb_interface(struct usb_interface *usb_intf)
+{
+	struct arena *arena = usb_intf->arena;
 
-		close(temp_file);
-		sprintf(file, "%s/%s", udev_device_get_syspath(device),
-			dirent->d_name);
-		interface = udev_device_new_from_syspath(udev, file);
-		if (interface == NULL) {
-			fprintf(stderr, "can't get interface for %s?\n", file);
-			continue;
-		}
+	list_del(&usb_intf->list);
+	if (arena) {
+		arena_release(arena);
+		free(arena);
+	}
+}
+
+void create_usb_interface(struct sysfs_dev *device, const char *name,
+			  struct usb_device *usb_device)
+{
+	struct usb_interface *usb_intf;
+	struct sysfs_dev interface;
+	const char *driver_name;
+	char driver[NAME_MAX];
+
+	/* the name and the driver are all there is to it, for now */
+	if (__atomic_load_n(&usb_interface_wanted, __ATOMIC_RELAXED) == 0) {
 		usb_intf = new_usb_interface();
+		INIT_LIST_HEAD(&usb_intf->config_list);
 		INIT_LIST_HEAD(&usb_intf->endpoints);
-		usb_intf->bAlternateSetting	= get_dev_string(interface, "bAlternateSetting");
-		usb_intf->bInterfaceClass	= get_dev_string(interface, "bInterfaceClass");
-		usb_intf->bInterfaceNumber	= get_dev_string(interface, "bInterfaceNumber");
-		usb_intf->bInterfaceProtocol	= get_dev_string(interface, "bInterfaceProtocol");
-		usb_intf->bInterfaceSubClass	= get_dev_string(interface, "bInterfaceSubClass");
-		usb_intf->bNumEndpoints		= get_dev_string(interface, "bNumEndpoints");
-		usb_intf->sysname		= strdup(udev_device_get_sysname(interface));
-
-		driver_name = udev_device_get_driver(interface);
+		usb_intf->sysname = robust_strdup(name);
+		driver_name = get_dev_child_driver(device, name, driver,
+						   sizeof(driver));
 		if (driver_name)
-			usb_intf->driver = strdup(driver_name);
+			usb_intf->driver = robust_intern(driver_name);
 		list_add_tail(&usb_intf->list, &usb_device->interfaces);
+		return;
+	}
 
-		/* find all endpoints for this interface, and save them */
-		create_usb_interface_endpoints(interface, usb_intf);
-
-		udev_device_unref(interface);
+	if (open_child_dev(device, name, &interface)) {
+		fprintf(stderr, "can't get interface for %s?\n", name);
+		return;
 	}
-	closedir(dir);
+	build_usb_interface(&interface, usb_device);
+	close_dev(&interface);
 }
 
+/*
+ * Descriptor mode: the interfaces were already built from the raw
+ * descriptors, with all of their alternate settings.  Put the first setting
+ * of each interface of the active config on the device, and only go to sysfs
+ * to see what driver is bound to it.
+ */
+void create_usb_interfaces_from_descriptors(struct sysfs_dev *device,
+					    struct usb_device *usb_device)
+{
+	struct usb_interface *usb_intf;
+	struct usb_config *config;
+	const char *driver_name;
+	char driver[NAME_MAX];
+	char name[64];
+
+	list_for_each_entry(config, &usb_device->configs, list) {
+		if (config->bConfigurationValue != usb_device->bConfigurationValue)
+			continue;
+		list_for_each_entry(usb_intf, &config->interfaces, config_list) {
+			if (usb_intf->bAlternateSetting != 0)
+				continue;
+			/* root hub "usbN" has interfaces called "N-0:1.0" */
+			if (strncmp(usb_device->sysname, "usb", 3) == 0)
+				snprintf(name, sizeof(name), "%u-0:%u.%u",
+					 usb_device->busnum,
+					 usb_intf->configuration,
+					 usb_intf->ifnum);
+			else
+				snprintf(name, sizeof(name), "%s:%u.%u",
+					 usb_device->sysname,
+					 usb_intf->configuration,
+					 usb_intf->ifnum);
+			usb_intf->sysname = robust_strdup(name);
+			usb_intf->loaded = USB_ATTRS_ALL;
+			driver_name = get_dev_child_driver(device, name, driver,
+							   sizeof(driver));
+			if (driver_name)
+				usb_intf->driver = robust_intern(driver_name);
+			list_add_tail(&usb_intf->list, &usb_device->interfaces);
+		}
+	}
+}
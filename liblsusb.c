@@ -0,0 +1,362 @@
+/*
+ * liblsusb.c
+ *
+ * The library side of lsusb, see liblsusb.h
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "liblsusb.h"
+#include "arena.h"
+
+
+
+struct lsusb_context {
+	char *sysroot;
+	int use_libudev;
+};
+
+/*
+ * Where sysfs is, which backend to use and what to read are still plain
+ * globals underneath, shared with the lsusb front end.  So a scan takes the
+ * lock, puts its own settings in place, and puts back what was there when
+ * it is done.  Everything else is per thread (the udev handle and the batch
+ * of attribute reads, see sysfs_thread_init()) or in the snapshot.
+ */
+static pthread_mutex_t scan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct lsusb_context *lsusb_new(void)
+{
+	struct lsusb_context *ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	ctx->use_libudev = use_libudev;
+	return ctx;
+}
+
+void lsusb_free(struct lsusb_context *ctx)
+{
+	if (ctx == NULL)
+		return;
+	free(ctx->sysroot);
+	free(ctx);
+}
+
+/* libudev only knows about the real /sys, a copy is read directly */
+int lsusb_set_sysroot(struct lsusb_context *ctx, const char *sysroot)
+{
+	char *copy = NULL;
+
+	if (sysroot) {
+		copy = strdup(sysroot);
+		if (copy == NULL)
+			return -1;
+	}
+	free(ctx->sysroot);
+	ctx->sysroot = copy;
+	ctx->use_libudev = sysroot ? 0 : use_libudev;
+	return 0;
+}
+
+static struct lsusb_snapshot *new_snapshot(void)
+{
+	struct lsusb_snapshot *snapshot;
+
+	snapshot = calloc(1, sizeof(*snapshot));
+	if (snapshot == NULL)
+		return NULL;
+	snapshot->arena = calloc(1, sizeof(*snapshot->arena));
+	if (snapshot->arena == NULL) {
+		free(snapshot);
+		return NULL;
+	}
+	snapshot->refcount = 1;
+	INIT_LIST_HEAD(&snapshot->devices);
+	return snapshot;
+}
+
+static void free_snapshot(struct lsusb_snapshot *snapshot)
+{
+	free_usb_devices(snapshot);
+	free(snapshot->arena);
+	free(snapshot);
+}
+
+/*
+ * Read everything about every device into a new snapshot.  There is no
+ * going back to sysfs for anything later on (the snapshot may well outlive
+ * the devices), so all of the attributes are read up front.
+ */
+struct lsusb_snapshot *lsusb_scan(struct lsusb_context *ctx)
+{
+	struct lsusb_snapshot *snapshot;
+	struct usb_device *usb_device;
+	struct sysfs_dev device;
+	struct sysfs_scan scan;
+	const char *old_root;
+	struct arena *old_arena;
+	u32 old_device_wanted;
+	u32 old_interface_wanted;
+	int old_libudev;
+	unsigned int i;
+	int retval;
+
+	snapshot = new_snapshot();
+	if (snapshot == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&scan_lock);
+	old_root = sysfs_root;
+	old_libudev = use_libudev;
+	old_device_wanted = usb_device_wanted;
+	old_interface_wanted = usb_interface_wanted;
+	if (ctx->sysroot)
+		sysfs_root = ctx->sysroot;
+	use_libudev = ctx->use_libudev;
+	usb_device_wanted = USB_ATTRS_ALL;
+	usb_interface_wanted = USB_ATTRS_ALL;
+	old_arena = use_arena(snapshot->arena);
+	sysfs_thread_init();
+
+	retval = sysfs_scan_begin(&scan);
+	if (retval == 0) {
+		for (i = 0; i < scan.count; i++) {
+			if (sysfs_scan_open(&scan, i, &device))
+				continue;
+			usb_device = create_usb_device(&device, NULL);
+			close_dev(&device);
+			if (usb_device)
+				add_usb_device(snapshot, usb_device);
+		}
+		sysfs_scan_end(&scan);
+		sort_usb_devices(snapshot, SORT_BUSDEV);
+	}
+
+	sysfs_thread_exit();
+	use_arena(old_arena);
+	usb_interface_wanted = old_interface_wanted;
+	usb_device_wanted = old_device_wanted;
+	use_libudev = old_libudev;
+	sysfs_root = old_root;
+	pthread_mutex_unlock(&scan_lock);
+
+	if (retval) {
+		free_snapshot(snapshot);
+		return NULL;
+	}
+	return snapshot;
+}
+
+struct lsusb_snapshot *lsusb_snapshot_ref(struct lsusb_snapshot *snapshot)
+{
+	__atomic_add_fetch(&snapshot->refcount, 1, __ATOMIC_RELAXED);
+	return snapshot;
+}
+
+void lsusb_snapshot_unref(struct lsusb_snapshot *snapshot)
+{
+	if (snapshot && __atomic_sub_fetch(&snapshot->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+		free_snapshot(snapshot);
+}
+
+/*
+ * The handles in liblsusb.h are the structures from usb.h underneath, which
+ * stay out of the header so that they can change without anyone noticing.
+ */
+#define usb_device_of(device)		((struct usb_device *)(device))
+#define usb_interface_of(interface)	((struct usb_interface *)(interface))
+#define usb_endpoint_of(endpoint)	((struct usb_endpoint *)(endpoint))
+
+static struct lsusb_device *lsusb_device_of(struct usb_device *usb_device)
+{
+	return (struct lsusb_device *)usb_device;
+}
+
+static struct lsusb_interface *lsusb_interface_of(struct usb_interface *usb_interface)
+{
+	return (struct lsusb_interface *)usb_interface;
+}
+
+static struct lsusb_endpoint *lsusb_endpoint_of(struct usb_endpoint *usb_endpoint)
+{
+	return (struct lsusb_endpoint *)usb_endpoint;
+}
+
+struct lsusb_device *lsusb_first_device(struct lsusb_snapshot *snapshot)
+{
+	if (list_empty(&snapshot->devices))
+		return NULL;
+	return lsusb_device_of(list_entry(snapshot->devices.next,
+					  struct usb_device, list));
+}
+
+struct lsusb_device *lsusb_next_device(struct lsusb_snapshot *snapshot,
+				       struct lsusb_device *device)
+{
+	struct usb_device *usb_device = usb_device_of(device);
+
+	if (usb_device->list.next == &snapshot->devices)
+		return NULL;
+	return lsusb_device_of(list_entry(usb_device->list.next,
+					  struct usb_device, list));
+}
+
+struct lsusb_device *lsusb_find_device(struct lsusb_snapshot *snapshot,
+				       const char *sysname)
+{
+	return lsusb_device_of(find_usb_device(snapshot, sysname));
+}
+
+struct lsusb_interface *lsusb_first_interface(struct lsusb_device *device)
+{
+	struct usb_device *usb_device = usb_device_of(device);
+
+	if (list_empty(&usb_device->interfaces))
+		return NULL;
+	return lsusb_interface_of(list_entry(usb_device->interfaces.next,
+					     struct usb_interface, list));
+}
+
+struct lsusb_interface *lsusb_next_interface(struct lsusb_device *device,
+					     struct lsusb_interface *interface)
+{
+	struct usb_interface *usb_interface = usb_interface_of(interface);
+
+	if (usb_interface->list.next == &usb_device_of(device)->interfaces)
+		return NULL;
+	return lsusb_interface_of(list_entry(usb_interface->list.next,
+					     struct usb_interface, list));
+}
+
+struct lsusb_endpoint *lsusb_first_endpoint(struct lsusb_interface *interface)
+{
+	struct usb_interface *usb_interface = usb_interface_of(interface);
+
+	if (list_empty(&usb_interface->endpoints))
+		return NULL;
+	return lsusb_endpoint_of(list_entry(usb_interface->endpoints.next,
+					    struct usb_endpoint, list));
+}
+
+struct lsusb_endpoint *lsusb_next_endpoint(struct lsusb_interface *interface,
+					   struct lsusb_endpoint *endpoint)
+{
+	struct usb_endpoint *usb_endpoint = usb_endpoint_of(endpoint);
+
+	if (usb_endpoint->list.next == &usb_interface_of(interface)->endpoints)
+		return NULL;
+	return lsusb_endpoint_of(list_entry(usb_endpoint->list.next,
+					    struct usb_endpoint, list));
+}
+
+/* one accessor for each field that is part of the interface */
+#define DEVICE_FIELD(type, name, field)					\
+type lsusb_device_##name(const struct lsusb_device *device)		\
+{									\
+	return usb_device_of(device)->field;				\
+}
+#define INTERFACE_FIELD(type, name, field)				\
+type lsusb_interface_##name(const struct lsusb_interface *interface)	\
+{									\
+	return usb_interface_of(interface)->field;			\
+}
+#define ENDPOINT_FIELD(type, name, field)				\
+type lsusb_endpoint_##name(const struct lsusb_endpoint *endpoint)	\
+{									\
+	return usb_endpoint_of(endpoint)->field;			\
+}
+
+DEVICE_FIELD(const char *, sysname, sysname)
+DEVICE_FIELD(const char *, manufacturer, manufacturer)
+DEVICE_FIELD(const char *, product, product)
+DEVICE_FIELD(const char *, serial, serial)
+DEVICE_FIELD(const char *, driver, driver)
+DEVICE_FIELD(unsigned int, busnum, busnum)
+DEVICE_FIELD(unsigned int, devnum, devnum)
+DEVICE_FIELD(unsigned int, idVendor, idVendor)
+DEVICE_FIELD(unsigned int, idProduct, idProduct)
+DEVICE_FIELD(unsigned int, bcdDevice, bcdDevice)
+DEVICE_FIELD(unsigned int, bcdUSB, version)
+DEVICE_FIELD(unsigned int, bDeviceClass, bDeviceClass)
+DEVICE_FIELD(unsigned int, bDeviceSubClass, bDeviceSubClass)
+DEVICE_FIELD(unsigned int, bDeviceProtocol, bDeviceProtocol)
+DEVICE_FIELD(unsigned int, bMaxPacketSize0, bMaxPacketSize0)
+DEVICE_FIELD(unsigned int, bNumConfigurations, bNumConfigurations)
+DEVICE_FIELD(unsigned int, bConfigurationValue, bConfigurationValue)
+DEVICE_FIELD(unsigned int, bNumInterfaces, bNumInterfaces)
+DEVICE_FIELD(unsigned int, bmAttributes, bmAttributes)
+DEVICE_FIELD(unsigned int, bMaxPower, bMaxPower)
+DEVICE_FIELD(unsigned int, speed, speed)
+DEVICE_FIELD(unsigned int, maxchild, maxchild)
+DEVICE_FIELD(unsigned int, quirks, quirks)
+
+INTERFACE_FIELD(const char *, sysname, sysname)
+INTERFACE_FIELD(const char *, driver, driver)
+INTERFACE_FIELD(unsigned int, bInterfaceNumber, bInterfaceNumber)
+INTERFACE_FIELD(unsigned int, bAlternateSetting, bAlternateSetting)
+INTERFACE_FIELD(unsigned int, bInterfaceClass, bInterfaceClass)
+INTERFACE_FIELD(unsigned int, bInterfaceSubClass, bInterfaceSubClass)
+INTERFACE_FIELD(unsigned int, bInterfaceProtocol, bInterfaceProtocol)
+INTERFACE_FIELD(unsigned int, bNumEndpoints, bNumEndpoints)
+
+ENDPOINT_FIELD(unsigned int, bEndpointAddress, bEndpointAddress)
+ENDPOINT_FIELD(unsigned int, bmAttributes, bmAttributes)
+ENDPOINT_FIELD(unsigned int, wMaxPacketSize, wMaxPacketSize)
+ENDPOINT_FIELD(unsigned int, bInterval, bInterval)
+
+struct lsusb_endpoint *lsusb_device_ep0(struct lsusb_device *device)
+{
+	return lsusb_endpoint_of(usb_device_of(device)->ep0);
+}
+
+const unsigned char *lsusb_device_descriptors(const struct lsusb_device *device,
+					      size_t *size)
+{
+	struct usb_device *usb_device = usb_device_of(device);
+
+	*size = usb_device->descriptors_size;
+	return usb_device->descriptors;
+}
+
+/* usb.ids is read in the first time a name is needed */
+void lsusb_device_names(const struct lsusb_device *device,
+			const char **vendor, const char **product)
+{
+	pthread_mutex_lock(&scan_lock);
+	usb_device_names(usb_device_of(device), vendor, product);
+	pthread_mutex_unlock(&scan_lock);
+}
+
+/* -t links the devices up before printing, so that takes the lock too */
+int lsusb_print(struct lsusb_snapshot *snapshot, int fd, const char *format)
+{
+	const struct usb_formatter *formatter;
+
+	formatter = find_usb_formatter(format);
+	if (formatter == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&scan_lock);
+	print_usb_devices(snapshot, fd, NULL, formatter);
+	pthread_mutex_unlock(&scan_lock);
+	return 0;
+}
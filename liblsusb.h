@@ -0,0 +1,127 @@
+/*
+ * liblsusb.h
+ *
+ * Everything lsusb knows about the usb devices, without running lsusb and
+ * picking its output apart.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#ifndef _LIBLSUSB_H
+#define _LIBLSUSB_H
+
+#include <stddef.h>
+
+/*
+ * A context holds the settings, lsusb_scan() reads all of the devices with
+ * them and hands back a snapshot.  The snapshot has everything in it, and
+ * nothing in it changes until the last reference to it is dropped.  So a
+ * polling loop is a scan, a walk over the devices, and an unref:
+ *
+ *	struct lsusb_context *ctx = lsusb_new();
+ *	struct lsusb_snapshot *snapshot = lsusb_scan(ctx);
+ *	struct lsusb_device *device;
+ *
+ *	for (device = lsusb_first_device(snapshot); device;
+ *	     device = lsusb_next_device(snapshot, device))
+ *		printf("%04x:%04x\n", lsusb_device_idVendor(device),
+ *		       lsusb_device_idProduct(device));
+ *	lsusb_snapshot_unref(snapshot);
+ *
+ * Snapshots can be used from any thread, and kept around for as long as
+ * they are needed.  Scans with different contexts can run at the same time
+ * but take turns, only one of them reads sysfs at once.
+ *
+ * Devices, interfaces and endpoints are only handles, they belong to the
+ * snapshot they came from and are good for as long as it is.
+ */
+struct lsusb_context;
+struct lsusb_snapshot;
+struct lsusb_device;
+struct lsusb_interface;
+struct lsusb_endpoint;
+
+struct lsusb_context *lsusb_new(void);
+void lsusb_free(struct lsusb_context *ctx);
+/* a copy of sysfs somewhere else, see lsusb --capture, NULL is /sys */
+int lsusb_set_sysroot(struct lsusb_context *ctx, const char *sysroot);
+
+struct lsusb_snapshot *lsusb_scan(struct lsusb_context *ctx);
+struct lsusb_snapshot *lsusb_snapshot_ref(struct lsusb_snapshot *snapshot);
+void lsusb_snapshot_unref(struct lsusb_snapshot *snapshot);
+
+/* NULL at the end, devices are sorted by bus and device number */
+struct lsusb_device *lsusb_first_device(struct lsusb_snapshot *snapshot);
+struct lsusb_device *lsusb_next_device(struct lsusb_snapshot *snapshot,
+				       struct lsusb_device *device);
+struct lsusb_device *lsusb_find_device(struct lsusb_snapshot *snapshot,
+				       const char *sysname);
+struct lsusb_interface *lsusb_first_interface(struct lsusb_device *device);
+struct lsusb_interface *lsusb_next_interface(struct lsusb_device *device,
+					     struct lsusb_interface *interface);
+struct lsusb_endpoint *lsusb_first_endpoint(struct lsusb_interface *interface);
+struct lsusb_endpoint *lsusb_next_endpoint(struct lsusb_interface *interface,
+					   struct lsusb_endpoint *endpoint);
+
+/*
+ * What there is to know about each of them.  The numbers are named after
+ * the fields of the USB descriptors they come from, like in lsusb --json,
+ * and the strings are NULL if the device does not have one.
+ */
+const char *lsusb_device_sysname(const struct lsusb_device *device);
+const char *lsusb_device_manufacturer(const struct lsusb_device *device);
+const char *lsusb_device_product(const struct lsusb_device *device);
+const char *lsusb_device_serial(const struct lsusb_device *device);
+const char *lsusb_device_driver(const struct lsusb_device *device);
+unsigned int lsusb_device_busnum(const struct lsusb_device *device);
+unsigned int lsusb_device_devnum(const struct lsusb_device *device);
+unsigned int lsusb_device_idVendor(const struct lsusb_device *device);
+unsigned int lsusb_device_idProduct(const struct lsusb_device *device);
+unsigned int lsusb_device_bcdDevice(const struct lsusb_device *device);
+unsigned int lsusb_device_bcdUSB(const struct lsusb_device *device);
+unsigned int lsusb_device_bDeviceClass(const struct lsusb_device *device);
+unsigned int lsusb_device_bDeviceSubClass(const struct lsusb_device *device);
+unsigned int lsusb_device_bDeviceProtocol(const struct lsusb_device *device);
+unsigned int lsusb_device_bMaxPacketSize0(const struct lsusb_device *device);
+unsigned int lsusb_device_bNumConfigurations(const struct lsusb_device *device);
+unsigned int lsusb_device_bConfigurationValue(const struct lsusb_device *device);
+unsigned int lsusb_device_bNumInterfaces(const struct lsusb_device *device);
+unsigned int lsusb_device_bmAttributes(const struct lsusb_device *device);
+/* in mA */
+unsigned int lsusb_device_bMaxPower(const struct lsusb_device *device);
+/* in kbit/s, 0 if unknown */
+unsigned int lsusb_device_speed(const struct lsusb_device *device);
+unsigned int lsusb_device_maxchild(const struct lsusb_device *device);
+unsigned int lsusb_device_quirks(const struct lsusb_device *device);
+/* endpoint 0, NULL if it could not be read */
+struct lsusb_endpoint *lsusb_device_ep0(struct lsusb_device *device);
+/* the raw "descriptors" file, what lsusb -v takes apart */
+const unsigned char *lsusb_device_descriptors(const struct lsusb_device *device,
+					      size_t *size);
+
+const char *lsusb_interface_sysname(const struct lsusb_interface *interface);
+const char *lsusb_interface_driver(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bInterfaceNumber(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bAlternateSetting(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bInterfaceClass(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bInterfaceSubClass(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bInterfaceProtocol(const struct lsusb_interface *interface);
+unsigned int lsusb_interface_bNumEndpoints(const struct lsusb_interface *interface);
+
+unsigned int lsusb_endpoint_bEndpointAddress(const struct lsusb_endpoint *endpoint);
+unsigned int lsusb_endpoint_bmAttributes(const struct lsusb_endpoint *endpoint);
+unsigned int lsusb_endpoint_wMaxPacketSize(const struct lsusb_endpoint *endpoint);
+unsigned int lsusb_endpoint_bInterval(const struct lsusb_endpoint *endpoint);
+
+/* what lsusb would call it, @product is NULL if usb.ids has no idea */
+void lsusb_device_names(const struct lsusb_device *device,
+			const char **vendor, const char **product);
+
+/* all of @snapshot as lsusb would print it, @format is "text", "json", ... */
+int lsusb_print(struct lsusb_snapshot *snapshot, int fd, const char *format);
+
+#endif	/* define _LIBLSUSB_H */
@@ -23,94 +23,452 @@
 #include <limits.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 
-#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
-
-#include <libudev.h>
 #include "list.h"
 #include "usb.h"
 #include "lsusb.h"
+#include "arena.h"
 
 
 
-static LIST_HEAD(usb_devices);
-struct udev *udev;
+/*
+ * The devices we show.  Everything built up during the scan comes out of
+ * scan_arena, and is thrown away all at once in free_usb_devices().  Worker
+ * threads allocate out of an arena of their own, which is handed over to
+ * scan_arena when they are done.
+ */
+struct lsusb_snapshot usb_devices = {
+	.refcount	= 1,
+	.arena		= &scan_arena,
+	.devices	= LIST_HEAD_INIT(usb_devices.devices),
+};
 
-void *robust_malloc(size_t size)
+static void print_arena_stats(void)
 {
-	void *data;
+	fprintf(stderr, "arena: %zu bytes used in %u chunks, high water %zu bytes\n",
+		scan_arena.used, scan_arena.nchunks, scan_arena.high_water);
+	fprintf(stderr, "strings: %u interned, %zu bytes in %u chunks\n",
+		interned_strings, intern_arena.used, intern_arena.nchunks);
+}
 
-	data = malloc(size);
-	if (data == NULL)
-		exit(1);
-	memset(data, 0, size);
-	return data;
+/*
+ * How the devices get printed.  --ndjson streams: every device goes out on
+ * its own as soon as it has been built, in the order the scan finds them
+ * (with -j, in the order the workers finish them), instead of all of them
+ * at the end.  The workers take turns at the one buffer.
+ */
+static const struct usb_formatter *formatter = &text_formatter;
+static const struct usb_filter *stream_filter;
+static struct outbuf *stream_out;
+static struct outbuf stream_buffer;
+static pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Devices that can't match the filter are not even built.  The daemon has to
+ * have them all, it answers all sorts of queries.
+ */
+static const struct usb_filter *scan_filter;
+
+static void stream_usb_device(struct usb_device *usb_device)
+{
+	if (stream_out == NULL || usb_device == NULL ||
+	    !match_usb_device(stream_filter, usb_device))
+		return;
+	pthread_mutex_lock(&stream_lock);
+	formatter->device(stream_out, usb_device);
+	out_flush(stream_out);
+	pthread_mutex_unlock(&stream_lock);
 }
 
-char *get_dev_string(struct udev_device *device, const char *name)
+static void scan_usb_devices_serial(struct sysfs_scan *scan)
 {
-	const char *value;
+	struct usb_device *usb_device;
+	struct sysfs_dev device;
+	unsigned int i;
 
-	value = udev_device_get_sysattr_value(device, name);
-	if (value != NULL)
-		return strdup(value);
-	return NULL;
+	for (i = 0; i < scan->count; i++) {
+		if (!usb_filter_may_match(scan_filter, scan->names[i]) ||
+		    sysfs_scan_open(scan, i, &device))
+			continue;
+		usb_device = create_usb_device(&device, scan_filter);
+		close_dev(&device);
+		if (usb_device == NULL)
+			continue;
+		stream_usb_device(usb_device);
+		add_usb_device(&usb_devices, usb_device);
+	}
 }
 
+/*
+ * Parallel scan.  The scan entries are handed out to the workers in order,
+ * and each device ends up in the slot of the entry it came from, so when the
+ * workers are done the list is put together in exactly the order a serial
+ * scan would have built it, and the output can not tell the difference.
+ */
+#define MAX_JOBS	256	/* a thread each, -j asks for no more than this */
+
+struct scan_work {
+	struct sysfs_scan *scan;
+	struct usb_device **devices;
+	unsigned int next;
+};
+
+struct scan_worker {
+	pthread_t thread;
+	struct scan_work *work;
+	struct arena arena;
+};
+
+static void *scan_worker_thread(void *data)
+{
+	struct scan_worker *worker = data;
+	struct scan_work *work = worker->work;
+	struct sysfs_dev device;
+	unsigned int i;
 
-//int main(int argc, char *argv[])
-int main(void)
+	sysfs_thread_init();
+	use_arena(&worker->arena);
+	while ((i = __sync_fetch_and_add(&work->next, 1)) < work->scan->count) {
+		if (!usb_filter_may_match(scan_filter, work->scan->names[i]) ||
+		    sysfs_scan_open(work->scan, i, &device))
+			continue;
+		work->devices[i] = create_usb_device(&device, scan_filter);
+		stream_usb_device(work->devices[i]);
+		close_dev(&device);
+	}
+	sysfs_thread_exit();
+	return NULL;
+}
+
+static void scan_usb_devices_parallel(struct sysfs_scan *scan, unsigned int jobs)
 {
-	struct udev_enumerate *enumerate;
-	struct udev_list_entry *list_entry;
-
-	/* libudev context */
-	udev = udev_new();
-
-	/* prepare a device scan */
-	enumerate = udev_enumerate_new(udev);
-	/* filter for usb devices */
-	udev_enumerate_add_match_subsystem(enumerate, "usb");
-	/* retrieve the list */
-	udev_enumerate_scan_devices(enumerate);
-	/* print devices */
-	udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(enumerate)) {
-		struct udev_device *device;
-
-		device = udev_device_new_from_syspath(udev_enumerate_get_udev(enumerate),
-						      udev_list_entry_get_name(list_entry));
-		if (device == NULL)
+	struct scan_worker *workers;
+	struct scan_work work;
+	unsigned int i;
+
+	memset(&work, 0, sizeof(work));
+	work.scan = scan;
+	work.devices = calloc(scan->count + 1, sizeof(*work.devices));
+	workers = calloc(jobs, sizeof(*workers));
+	if (work.devices == NULL || workers == NULL)
+		exit(1);
+
+	for (i = 0; i < jobs; i++) {
+		workers[i].work = &work;
+		if (pthread_create(&workers[i].thread, NULL,
+				   scan_worker_thread, &workers[i]) != 0) {
+			fprintf(stderr, "can't create scan thread\n");
+			exit(1);
+		}
+	}
+	for (i = 0; i < jobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+		arena_adopt(&scan_arena, &workers[i].arena);
+	}
+
+	for (i = 0; i < scan->count; i++) {
+		if (work.devices[i] == NULL)
 			continue;
-		if (strcmp("usb_device", udev_device_get_devtype(device)) == 0)
-//		if (strstr(udev_device_get_sysname(device), "usb") != NULL)
-			create_usb_device(device);
-#if 0
-		printf("%s: ", udev_list_entry_get_name(list_entry));
-		printf("\tdevtype: %s\n", udev_device_get_devtype(device));
-		printf("\tsubsystem: %s\n", udev_device_get_subsystem(device));
-		printf("\tsyspath: %s\n", udev_device_get_syspath(device));
-		printf("\tsysnum: %s\n", udev_device_get_sysnum(device));
-		printf("\tsysname: %s\n", udev_device_get_sysname(device));
-		printf("\tdevpath: %s\n", udev_device_get_devpath(device));
-		printf("\tdevnode: %s\n", udev_device_get_devnode(device));
-		printf("\tdriver: %s\n", udev_device_get_driver(device));
-
-		if (strcmp("usb_device", udev_device_get_devtype(device)) == 0)
-			create_usb_device(device);
-
-		if (strcmp("usb_interface", udev_device_get_devtype(device)) == 0)
-			create_usb_interface(device);
+		add_usb_device(&usb_devices, work.devices[i]);
+	}
+	free(workers);
+	free(work.devices);
+}
+
+static const struct option options[] = {
+	{ "arena-stats",	no_argument,		NULL, 'A' },
+	{ "backend",		required_argument,	NULL, 'B' },
+	{ "bus",		required_argument,	NULL, 'U' },
+	{ "capture",		required_argument,	NULL, 'T' },
+	{ "class",		required_argument,	NULL, 'C' },
+	{ "compile-ids",	no_argument,		NULL, 'Z' },
+	{ "client",		no_argument,		NULL, 'Q' },
+	{ "daemon",		no_argument,		NULL, 'R' },
+	{ "device",		required_argument,	NULL, 'd' },
+	{ "from-descriptors",	no_argument,		NULL, 'D' },
+	{ "id",			required_argument,	NULL, 'P' },
+	{ "ids",		required_argument,	NULL, 'N' },
+	{ "io",			required_argument,	NULL, 'I' },
+	{ "jobs",		required_argument,	NULL, 'j' },
+	{ "json",		no_argument,		NULL, 'J' },
+	{ "load",		required_argument,	NULL, 'L' },
+	{ "ndjson",		no_argument,		NULL, 'E' },
+	{ "save",		required_argument,	NULL, 'O' },
+	{ "slot",		required_argument,	NULL, 's' },
+	{ "socket",		required_argument,	NULL, 'K' },
+	{ "stats",		optional_argument,	NULL, 'X' },
+	{ "sort",		required_argument,	NULL, 'S' },
+	{ "sysroot",		required_argument,	NULL, 'Y' },
+	{ "tree",		no_argument,		NULL, 't' },
+	{ "verbose",		no_argument,		NULL, 'v' },
+	{ "watch",		no_argument,		NULL, 'W' },
+	{ }
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-t | -v] [-j N] [-d [vendor]:[product]] [-s [[bus]:][devnum]]\n"
+			"\t[--arena-stats] [--stats[=json]] [--backend=udev|sysfs]\n"
+			"\t[--from-descriptors] [--io=sync|uring] [--sort=busdev|id|path]\n"
+			"\t[--bus=N] [--id=vvvv[:pppp]] [--class=CC]\n"
+			"\t[--watch | --daemon | --client] [--socket=PATH]\n"
+			"\t[--save=FILE | --load=FILE] [--sysroot=DIR] [--capture=DIR]\n"
+			"\t[--ids=FILE] [--compile-ids] [--json | --ndjson]\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sysfs_scan scan;
+	enum usb_sort_key sort_key = SORT_BUSDEV;
+	const char *socket_path = LSUSB_SOCKET;
+	const char *save_file = NULL;
+	const char *load_file = NULL;
+	const char *capture_dir = NULL;
+	const char *sysroot = NULL;
+	struct usb_filter filter;
+	unsigned int jobs = 1;
+	unsigned long value;
+	char *end;
+	int arena_stats = 0;
+	int stats_json = 0;
+	int watch = 0;
+	int daemon_mode = 0;
+	int client = 0;
+	int compile_ids = 0;
+	int monitor_fd = -1;
+	int retval = 0;
+	int option;
+
+	init_usb_filter(&filter);
+
+	while ((option = getopt_long(argc, argv, "d:j:s:tv", options, NULL)) != -1) {
+		switch (option) {
+		case 'A':
+			arena_stats = 1;
+			break;
+		case 'B':
+			if (strcmp(optarg, "sysfs") == 0)
+				use_libudev = 0;
+#ifdef HAVE_LIBUDEV
+			else if (strcmp(optarg, "udev") == 0)
+				use_libudev = 1;
 #endif
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'D':
+			descriptor_mode = 1;
+			break;
+		case 'I':
+			if (strcmp(optarg, "sync") == 0)
+				io_engine = IO_SYNC;
+			else if (strcmp(optarg, "uring") == 0)
+				io_engine = IO_URING;
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'j':
+			errno = 0;
+			value = strtoul(optarg, &end, 10);
+			if (errno || end == optarg || *end != '\0' ||
+			    value == 0 || value > MAX_JOBS) {
+				usage(argv[0]);
+				return 1;
+			}
+			jobs = value;
+			break;
+		case 'J':
+			formatter = &json_formatter;
+			break;
+		case 't':
+			formatter = &tree_formatter;
+			break;
+		case 'v':
+			formatter = &verbose_formatter;
+			break;
+		case 'E':
+			formatter = &ndjson_formatter;
+			break;
+		case 'K':
+			socket_path = optarg;
+			break;
+		case 'L':
+			load_file = optarg;
+			break;
+		case 'N':
+			usb_ids_file = optarg;
+			break;
+		case 'O':
+			save_file = optarg;
+			break;
+		case 'Q':
+			client = 1;
+			break;
+		case 'T':
+			capture_dir = optarg;
+			break;
+		case 'Y':
+			sysroot = optarg;
+			break;
+		case 'R':
+			daemon_mode = 1;
+			break;
+		case 'S':
+			if (parse_usb_sort_key(optarg, &sort_key)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'C':
+		case 'P':
+		case 'd':
+		case 's':
+		case 'U':
+			if (parse_usb_filter(&filter, option == 'C' ? "class" :
+					     option == 's' ? "slot" :
+					     option == 'U' ? "bus" : "id", optarg)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'W':
+			watch = 1;
+			break;
+		case 'Z':
+			compile_ids = 1;
+			break;
+		case 'X':
+			if (optarg && strcmp(optarg, "json") == 0)
+				stats_json = 1;
+			else if (optarg) {
+				usage(argv[0]);
+				return 1;
+			}
+			stats_enabled = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	/*
+	 * A captured tree is plain files, libudev only knows about the real
+	 * /sys, and nothing is ever going to happen in there to watch for.
+	 */
+	if (sysroot) {
+		if (watch || (daemon_mode && !load_file)) {
+			usage(argv[0]);
+			return 1;
+		}
+		sysfs_root = sysroot;
+		use_libudev = 0;
+	}
+	if (capture_dir)
+		return capture_sysfs(capture_dir) ? 1 : 0;
+
+	/*
+	 * Only what gets printed is read in, unless everything is going to be
+	 * needed anyway, and then it is better read with the rest of the scan.
+	 */
+	usb_device_wanted |= formatter->device_attrs;
+	usb_interface_wanted |= formatter->interface_attrs;
+	if (save_file || daemon_mode) {
+		usb_device_wanted = USB_ATTRS_ALL;
+		usb_interface_wanted = USB_ATTRS_ALL;
+	} else if (filter.class != -1) {
+		usb_device_wanted |= USB_ATTR(DEVICE_CLASS);
+		usb_interface_wanted |= USB_ATTR(INTERFACE_CLASS);
+	}
+	if (compile_ids)
+		return compile_usb_ids() ? 1 : 0;
+
+	/* if there is a daemon around, it already has everything */
+	if (client && query_daemon(socket_path, &filter, sort_key, formatter) == 0)
+		return 0;
 
-		udev_device_unref(device);
+	/* a snapshot can be served, but it is not going to change */
+	if (load_file && (watch || save_file)) {
+		usage(argv[0]);
+		return 1;
 	}
-	udev_enumerate_unref(enumerate);
 
-	udev_unref(udev);
-	sort_usb_devices();
-	print_usb_devices();
-	free_usb_devices();
-	return 0;
+	if (watch || (daemon_mode && !load_file)) {
+		monitor_fd = watch_begin(daemon_mode ? NULL : stdout);
+		if (monitor_fd < 0) {
+			fprintf(stderr, "can't watch for usb devices coming and going\n");
+			return 1;
+		}
+	}
+
+	phase_begin();
+	sysfs_thread_init();
+	if (load_file) {
+		if (load_usb_snapshot(load_file)) {
+			fprintf(stderr, "can't load snapshot %s: %s\n",
+				load_file, strerror(errno));
+			return 1;
+		}
+	} else {
+		if (sysfs_scan_begin(&scan)) {
+			fprintf(stderr, "can't read the usb devices in %s\n", sysfs_root);
+			return 1;
+		}
+		phase_end(PHASE_ENUMERATE);
+		if (!daemon_mode)
+			scan_filter = &filter;
+		if (formatter == &ndjson_formatter && !daemon_mode) {
+			fflush(stdout);
+			out_init(&stream_buffer, STDOUT_FILENO);
+			stream_filter = &filter;
+			stream_out = &stream_buffer;
+		}
+		/* build up all of the devices */
+		if (jobs > 1)
+			scan_usb_devices_parallel(&scan, jobs);
+		else
+			scan_usb_devices_serial(&scan);
+		sysfs_scan_end(&scan);
+	}
+	phase_end(PHASE_BUILD);
+
+	if (save_file && save_usb_snapshot(save_file)) {
+		fprintf(stderr, "can't save snapshot %s: %s\n",
+			save_file, strerror(errno));
+		return 1;
+	}
+
+	phase_begin();
+	sort_usb_devices(&usb_devices, sort_key);
+	phase_end(PHASE_SORT);
+	/* the main thread reads in anything that shows up from here on */
+	if (daemon_mode) {
+		retval = run_daemon(socket_path, monitor_fd, sort_key);
+	} else {
+		/* anything stdio still has goes out first */
+		fflush(stdout);
+		if (stream_out == NULL)
+			print_usb_devices(&usb_devices, STDOUT_FILENO, &filter,
+					  formatter);
+		phase_end(PHASE_PRINT);
+		if (watch)
+			watch_usb_devices();
+	}
+	sysfs_thread_exit();
+	if (arena_stats)
+		print_arena_stats();
+	phase_begin();
+	free_usb_devices(&usb_devices);
+	phase_end(PHASE_TEARDOWN);
+	if (stats_enabled)
+		print_stats(stderr, stats_json);
+	return retval;
 }
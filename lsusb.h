@@ -6,27 +6,389 @@
 #define __stringify_1(x...)     #x
 #define __stringify(x...)       __stringify_1(x)
 
-/* Functions in the core */
+#define ARRAY_SIZE(x)		(sizeof(x) / sizeof((x)[0]))
+
+struct udev_device;
+struct udev_enumerate;
+
+/*
+ * A device or interface directory in sysfs.  With the libudev backend all
+ * of the work is done by udev_device, the sysfs backend reads everything
+ * relative to dirfd.
+ */
+struct sysfs_dev {
+	struct udev_device *udev_device;
+	int dirfd;
+	char sysname[64];
+};
+
+struct sysfs_scan {
+	struct udev_enumerate *enumerate;
+	char **names;
+	unsigned int count;
+	int busfd;
+};
+
+/* What sysfs_monitor_receive() saw happen, "add", "remove", "bind", ... */
+struct sysfs_event {
+	char action[16];
+	char devtype[16];	/* "usb_device" or "usb_interface" */
+};
+
+/*
+ * How to turn a sysfs attribute into a field of one of the structures in
+ * usb.h, see attr.c
+ */
+enum dev_attr_type {
+	ATTR_STRING,
+	ATTR_INTERN,		/* a string that many devices will have */
+	ATTR_DEC,
+	ATTR_HEX,
+	ATTR_SPEED,		/* "480" Mbit/s into kbit/s */
+	ATTR_BCD,		/* " 2.00" into 0x0200 */
+};
+
+struct dev_attr {
+	const char *name;
+	unsigned char type;
+	unsigned char size;
+	unsigned short offset;
+};
+
+#define DEV_ATTR(structure, field, attr_type)				\
+	{ __stringify(field), attr_type,				\
+	  sizeof(((structure *)0)->field), offsetof(structure, field) }
+
+enum io_engine {
+	IO_AUTO,		/* io_uring if we can, plain reads if not */
+	IO_SYNC,
+	IO_URING,
+};
+
+/*
+ * The devices one scan found, with everything allocated for them.  lsusb
+ * has the one in usb_devices, which --watch and --daemon keep up to date,
+ * the library hands out a new one for every scan.
+ */
+#define USB_DEVICE_HASH_SIZE	256
+
+struct lsusb_snapshot {
+	unsigned int refcount;
+	struct arena *arena;		/* hotplugged devices have their own */
+	struct list_head devices;
+	struct usb_device *hash[USB_DEVICE_HASH_SIZE];	/* by sysname */
+};
+
+/* arena.c */
 void *robust_malloc(size_t size);
-char *get_dev_string(struct udev_device *device, const char *name);
-extern struct udev *udev;
+char *robust_strdup(const char *string);
+char *robust_intern(const char *string);
+extern struct arena scan_arena;
+extern struct arena intern_arena;
+extern unsigned int interned_strings;
+struct arena *use_arena(struct arena *arena);
+
+/* lsusb.c */
+extern struct lsusb_snapshot usb_devices;
+
+/* stats.c */
+enum stat_phase {
+	PHASE_ENUMERATE,	/* finding the devices */
+	PHASE_BUILD,		/* reading everything about them */
+	PHASE_SORT,
+	PHASE_PRINT,
+	PHASE_TEARDOWN,
+	NR_PHASES,
+};
+
+enum stat_counter {
+	STAT_DEVICES,
+	STAT_OPENS,
+	STAT_READS,		/* read(), getdents64() and readlink() */
+	STAT_READ_BYTES,
+	STAT_ALLOCS,
+	STAT_ALLOC_BYTES,
+	NR_STAT_COUNTERS,
+};
+
+/* parts of building a device, summed over all of them */
+enum stat_timer {
+	TIMER_DESCRIPTORS,	/* read_raw_usb_descriptor() */
+	TIMER_DIRECTORIES,	/* walking the device for interfaces and endpoints */
+	TIMER_ATTRIBUTES,	/* flush_dev_attrs() */
+	NR_STAT_TIMERS,
+};
+
+extern int stats_enabled;
+extern unsigned long stat_counters[NR_STAT_COUNTERS];
+
+/* workers count too, and there is nothing to count without --stats */
+static inline void count_stat(enum stat_counter counter, unsigned long n)
+{
+	if (stats_enabled)
+		__atomic_fetch_add(&stat_counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void phase_begin(void);
+void phase_end(enum stat_phase phase);
+unsigned long stat_timer_begin(void);
+void stat_timer_end(enum stat_timer timer, unsigned long start);
+void print_stats(FILE *file, int json);
+
+/* attr.c */
+extern enum io_engine io_engine;
+void attr_thread_init(void);
+void attr_thread_exit(void);
+void queue_dev_attr_set(struct sysfs_dev *dev, const char *dir, void *object,
+			const struct dev_attr *attrs, unsigned int count,
+			u32 mask);
+void queue_dev_attrs(struct sysfs_dev *dev, const char *dir, void *object,
+		     const struct dev_attr *attrs, unsigned int count);
+void flush_dev_attrs(void);
+
+/* sysfs.c */
+extern const char *sysfs_root;
+extern int use_libudev;
+void sysfs_thread_init(void);
+void sysfs_thread_exit(void);
+const char *read_dev_attr(struct sysfs_dev *dev, const char *name,
+			  char *value, size_t size);
+int open_dev_file(struct sysfs_dev *dev, const char *name);
+int read_dev_dir(struct sysfs_dev *dev,
+		 void (*fn)(const char *name, unsigned char type, void *data),
+		 void *data);
+const char *get_dev_sysname(struct sysfs_dev *dev);
+const char *get_dev_driver(struct sysfs_dev *dev, char *driver, size_t size);
+const char *get_dev_child_driver(struct sysfs_dev *dev, const char *child,
+				 char *driver, size_t size);
+int open_child_dev(struct sysfs_dev *dev, const char *name, struct sysfs_dev *child);
+int open_usb_dev(const char *sysname, struct sysfs_dev *dev);
+void close_dev(struct sysfs_dev *dev);
+int sysfs_scan_begin(struct sysfs_scan *scan);
+int sysfs_scan_open(struct sysfs_scan *scan, unsigned int i, struct sysfs_dev *dev);
+void sysfs_scan_end(struct sysfs_scan *scan);
+int sysfs_monitor_begin(void);
+int sysfs_monitor_receive(struct sysfs_dev *dev, struct sysfs_event *event);
+void sysfs_monitor_end(void);
 
 /* device.c */
-void create_usb_device(struct udev_device *device);
-void free_usb_devices(void);
-void sort_usb_devices(void);
-void print_usb_devices(void);
+enum usb_sort_key {
+	SORT_BUSDEV,		/* bus number, then device number */
+	SORT_ID,		/* idVendor:idProduct */
+	SORT_PATH,		/* bus, then the port numbers down the tree */
+};
+
+/* which devices to show, -1 is "any" */
+struct usb_filter {
+	int busnum;
+	int devnum;
+	int idVendor;
+	int idProduct;
+	int class;		/* of the device or any of its interfaces */
+};
+
+/*
+ * What is loaded of a device or interface, one bit per sysfs attribute in
+ * the order of usb_device_attrs[] and usb_interface_attrs[], plus what is in
+ * their subdirectories.  See load_usb_device().
+ */
+enum usb_device_attr {
+	DEVICE_MANUFACTURER,
+	DEVICE_PRODUCT,
+	DEVICE_SERIAL,
+	DEVICE_BUSNUM,
+	DEVICE_DEVNUM,
+	DEVICE_IDVENDOR,
+	DEVICE_IDPRODUCT,
+	DEVICE_BCDDEVICE,
+	DEVICE_CONFIGURATION_VALUE,
+	DEVICE_CLASS,
+	DEVICE_PROTOCOL,
+	DEVICE_SUBCLASS,
+	DEVICE_NUM_CONFIGURATIONS,
+	DEVICE_NUM_INTERFACES,
+	DEVICE_ATTRIBUTES,
+	DEVICE_MAX_PACKET_SIZE0,
+	DEVICE_MAX_POWER,
+	DEVICE_MAXCHILD,
+	DEVICE_QUIRKS,
+	DEVICE_SPEED,
+	DEVICE_VERSION,
+	NR_DEVICE_ATTRS,
+	DEVICE_EP0 = NR_DEVICE_ATTRS,	/* the ep_00 directory */
+	DEVICE_DESCRIPTORS,		/* a copy of the "descriptors" file */
+};
+
+enum usb_interface_attr {
+	INTERFACE_ALTERNATE_SETTING,
+	INTERFACE_CLASS,
+	INTERFACE_NUMBER,
+	INTERFACE_PROTOCOL,
+	INTERFACE_SUBCLASS,
+	INTERFACE_NUM_ENDPOINTS,
+	NR_INTERFACE_ATTRS,
+	INTERFACE_ENDPOINTS = NR_INTERFACE_ATTRS,	/* the ep_* directories */
+};
+
+#define USB_ATTR(attr)		(1U << (attr))
+#define USB_ATTRS_ALL		(~0U)
+
+/* what the plain listing prints, and sorts by */
+#define USB_DEVICE_LISTING	(USB_ATTR(DEVICE_MANUFACTURER) |	\
+				 USB_ATTR(DEVICE_PRODUCT) |		\
+				 USB_ATTR(DEVICE_BUSNUM) |		\
+				 USB_ATTR(DEVICE_DEVNUM) |		\
+				 USB_ATTR(DEVICE_IDVENDOR) |		\
+				 USB_ATTR(DEVICE_IDPRODUCT))
+/* and what -t adds to that */
+#define USB_DEVICE_TREE		(USB_ATTR(DEVICE_SPEED) |		\
+				 USB_ATTR(DEVICE_MAXCHILD))
+
+extern int descriptor_mode;
+extern u32 usb_device_wanted;
+extern u32 usb_interface_wanted;
+void load_usb_device(struct usb_device *usb_device, u32 mask);
+void load_usb_device_all(struct usb_device *usb_device);
+struct usb_device *create_usb_device(struct sysfs_dev *device,
+				     const struct usb_filter *filter);
+void add_usb_device(struct lsusb_snapshot *snapshot, struct usb_device *usb_device);
+struct usb_device *find_usb_device(struct lsusb_snapshot *snapshot,
+				   const char *sysname);
+void remove_usb_device(struct lsusb_snapshot *snapshot,
+		       struct usb_device *usb_device);
+void free_usb_devices(struct lsusb_snapshot *snapshot);
+int parse_usb_sort_key(const char *name, enum usb_sort_key *key);
+const char *usb_sort_key_name(enum usb_sort_key key);
+void sort_usb_devices(struct lsusb_snapshot *snapshot, enum usb_sort_key key);
+void link_usb_devices(struct lsusb_snapshot *snapshot);
+void init_usb_filter(struct usb_filter *filter);
+int parse_usb_filter(struct usb_filter *filter, const char *key, const char *value);
+void format_usb_filter(const struct usb_filter *filter, char *buf, size_t size);
+int usb_filter_may_match(const struct usb_filter *filter, const char *name);
+int match_usb_device(const struct usb_filter *filter,
+		     struct usb_device *usb_device);
+void usb_device_names(const struct usb_device *usb_device,
+		      const char **vendor, const char **product);
+struct outbuf;
+struct usb_formatter;
+void format_usb_devices(struct outbuf *out, struct lsusb_snapshot *snapshot,
+			const struct usb_filter *filter,
+			const struct usb_formatter *formatter);
+void print_usb_devices(struct lsusb_snapshot *snapshot, int fd,
+		       const struct usb_filter *filter,
+		       const struct usb_formatter *formatter);
+
+/* decode.c */
+struct outbuf;
+void decode_usb_descriptors(struct outbuf *out, const unsigned char *data,
+			    size_t size, u32 speed);
+
+/* output.c */
+#define OUTBUF_SIZE	65536
+
+struct outbuf {
+	int fd;			/* -1 keeps it all in mem, see out_take() */
+	int error;		/* a write failed, the rest is thrown away */
+	unsigned long records;	/* for the formatter to keep count */
+	size_t len;
+	char *mem;
+	size_t mem_len;
+	size_t mem_size;
+	char data[OUTBUF_SIZE];
+};
+
+/*
+ * One way of printing the device list.  begin and end are for whatever goes
+ * around the devices, and can be left out.  device is only called for the
+ * devices that match the filter begin is handed.  The attributes it is going to
+ * print, on top of USB_DEVICE_LISTING, are best read in with the scan.
+ */
+struct usb_formatter {
+	const char *name;
+	u32 device_attrs;
+	u32 interface_attrs;
+	void (*begin)(struct outbuf *out, struct lsusb_snapshot *snapshot,
+		      const struct usb_filter *filter);
+	void (*device)(struct outbuf *out, struct usb_device *usb_device);
+	void (*end)(struct outbuf *out);
+};
+
+extern const struct usb_formatter text_formatter;
+extern const struct usb_formatter json_formatter;
+extern const struct usb_formatter ndjson_formatter;
+extern const struct usb_formatter tree_formatter;
+extern const struct usb_formatter verbose_formatter;
+const struct usb_formatter *find_usb_formatter(const char *name);
+
+void out_init(struct outbuf *out, int fd);
+int out_flush(struct outbuf *out);
+char *out_take(struct outbuf *out, size_t *size);
+void out_mem(struct outbuf *out, const char *data, size_t size);
+void out_str(struct outbuf *out, const char *string);
+void out_char(struct outbuf *out, char c);
+void out_dec(struct outbuf *out, unsigned long value, unsigned int width);
+void out_hex(struct outbuf *out, unsigned long value, unsigned int width);
+
+/* watch.c */
+int watch_begin(FILE *file);
+void watch_event(void);
+void watch_usb_devices(void);
+
+/* daemon.c */
+#ifndef LSUSB_SOCKET
+#define LSUSB_SOCKET	"/run/lsusb.sock"
+#endif
+
+int run_daemon(const char *path, int monitor_fd, enum usb_sort_key key);
+int query_daemon(const char *path, const struct usb_filter *filter,
+		 enum usb_sort_key key, const struct usb_formatter *formatter);
+
+/* names.c */
+#ifndef USB_IDS
+#define USB_IDS		"/usr/share/usb.ids"
+#endif
+
+extern const char *usb_ids_file;
+const char *usb_vendor_name(u16 idVendor);
+const char *usb_product_name(u16 idVendor, u16 idProduct);
+int compile_usb_ids(void);
+
+/* capture.c */
+int capture_sysfs(const char *root);
+
+/* snapshot.c */
+int save_usb_snapshot(const char *filename);
+int load_usb_snapshot(const char *filename);
 
 /* interface.c */
-void create_usb_interface(struct udev_device *device, struct usb_device *usb_device);
-void free_usb_interface(struct usb_interface *usb_intf);
+int is_usb_interface_name(const char *name);
+void load_usb_interface(struct usb_device *usb_device,
+			struct usb_interface *usb_intf, u32 mask);
+struct usb_interface *build_usb_interface(struct sysfs_dev *interface,
+					  struct usb_device *usb_device);
+void remove_usb_interface(struct usb_interface *usb_intf);
+void create_usb_interface(struct sysfs_dev *device, const char *name,
+			  struct usb_device *usb_device);
+void create_usb_interfaces_from_descriptors(struct sysfs_dev *device,
+					    struct usb_device *usb_device);
 
 /* endpoint.c */
-struct usb_endpoint *create_usb_endpoint(struct udev_device *device,
+struct usb_endpoint *create_usb_endpoint(struct sysfs_dev *device,
 					 const char *endpoint_name);
-void free_usb_endpoint(struct usb_endpoint *usb_endpoint);
+struct usb_endpoint *create_usb_endpoint0(u8 bMaxPacketSize0);
+const char *usb_endpoint_direction(const struct usb_endpoint *usb_endpoint);
+const char *usb_endpoint_type(const struct usb_endpoint *usb_endpoint);
 
 /* raw.c */
-void read_raw_usb_descriptor(struct udev_device *device, struct usb_device *usb_device);
+/*
+ * bMaxPower counts 8mA at a time when the device runs at SuperSpeed (speed
+ * in kbit/s, as in sysfs), 2mA below that, whatever its bcdUSB says.
+ */
+#define USB_POWER_UNIT(speed)	((speed) >= 5000000 ? 8 : 2)
+
+int read_raw_usb_descriptor(struct sysfs_dev *device, struct usb_device *usb_device);
+void load_raw_usb_descriptor(struct sysfs_dev *device, struct usb_device *usb_device);
+void parse_raw_usb_descriptors(struct usb_device *usb_device,
+			       const unsigned char *data, size_t size);
 
 #endif	/* define _LSUSB_H */
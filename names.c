@@ -0,0 +1,472 @@
+/*
+ * names.c
+ *
+ * Vendor and product names out of usb.ids, through a compiled index when
+ * there is an up to date one.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+/*
+ * The index is usb.ids boiled down to two sorted tables of fixed size
+ * records, vendors and products, and a pool of the name strings they point
+ * into.  The products of a vendor sit next to each other, sorted, and the
+ * vendor record says where they are, so a lookup is a binary search through
+ * the vendors and then one through the products of that vendor, straight out
+ * of the mmap()ed file, with nothing to parse at all.
+ *
+ * It lives next to usb.ids as "usb.ids.idx", and remembers the size and
+ * modification time of the usb.ids it was made from.  If those don't match
+ * any more (or there is no index) usb.ids is parsed into the same tables in
+ * memory instead, and everything works just the same, only slower.
+ */
+#define IDS_INDEX_MAGIC		"LSUSBIDX"
+#define IDS_INDEX_VERSION	1
+#define IDS_INDEX_BYTE_ORDER	0x01020304
+
+struct ids_header {
+	char magic[8];
+	u32 version;
+	u32 byte_order;
+	u64 ids_size;
+	s64 ids_mtime;
+	u32 ids_mtime_nsec;
+	u32 nvendors;
+	u32 nproducts;
+	u32 strings_size;
+};
+
+struct ids_vendor {
+	u16 idVendor;
+	u16 pad;
+	u32 name;		/* offsets into the string pool */
+	u32 products;		/* first product of this vendor */
+	u32 nproducts;
+};
+
+struct ids_product {
+	u16 idVendor;
+	u16 idProduct;
+	u32 name;
+};
+
+struct usb_ids {
+	const struct ids_vendor *vendors;
+	const struct ids_product *products;
+	const char *strings;
+	u32 nvendors;
+	u32 nproducts;
+	u32 strings_size;
+};
+
+const char *usb_ids_file = USB_IDS;
+
+static struct usb_ids ids;
+static int ids_loaded;
+
+static void index_name(char *name, size_t size)
+{
+	snprintf(name, size, "%s.idx", usb_ids_file);
+}
+
+/*
+ * Parsing usb.ids.  Vendors are lines starting with 4 hex digits, their
+ * products follow indented by a tab.  Everything after the vendors (classes,
+ * HID usages, languages, ...) starts with something else, and is skipped
+ * along with whatever is indented below it.
+ */
+struct ids_builder {
+	struct ids_vendor *vendors;
+	struct ids_product *products;
+	char *strings;
+	u32 nvendors;
+	u32 nproducts;
+	u32 strings_size;
+	u32 vendors_allocated;
+	u32 products_allocated;
+	u32 strings_allocated;
+};
+
+static void *grow(void *array, u32 *allocated, u32 needed, size_t size)
+{
+	if (needed <= *allocated)
+		return array;
+	while (*allocated < needed)
+		*allocated = *allocated ? *allocated * 2 : 1024;
+	array = realloc(array, *allocated * size);
+	if (array == NULL)
+		exit(1);
+	return array;
+}
+
+static u32 add_string(struct ids_builder *builder, const char *string, size_t len)
+{
+	u32 offset = builder->strings_size;
+
+	builder->strings = grow(builder->strings, &builder->strings_allocated,
+				offset + len + 1, 1);
+	memcpy(builder->strings + offset, string, len);
+	builder->strings[offset + len] = '\0';
+	builder->strings_size += len + 1;
+	return offset;
+}
+
+static int parse_hex(const char *line, unsigned int digits, u16 *value)
+{
+	unsigned int i;
+
+	*value = 0;
+	for (i = 0; i < digits; i++) {
+		if (!isxdigit((unsigned char)line[i]))
+			return -1;
+		*value = *value * 16 +
+			 (isdigit((unsigned char)line[i]) ? line[i] - '0' :
+			  tolower((unsigned char)line[i]) - 'a' + 10);
+	}
+	/* the name is after two spaces */
+	return line[i] == ' ' && line[i + 1] == ' ' ? 0 : -1;
+}
+
+static void parse_ids_line(struct ids_builder *builder, const char *line,
+			   size_t len, int *in_vendor)
+{
+	struct ids_vendor *vendor;
+	struct ids_product *product;
+	u16 id;
+
+	if (len == 0 || line[0] == '#')
+		return;
+	if (line[0] != '\t') {
+		*in_vendor = len > 6 && parse_hex(line, 4, &id) == 0;
+		if (!*in_vendor)
+			return;
+		builder->vendors = grow(builder->vendors, &builder->vendors_allocated,
+					builder->nvendors + 1, sizeof(*vendor));
+		vendor = &builder->vendors[builder->nvendors++];
+		memset(vendor, 0, sizeof(*vendor));
+		vendor->idVendor = id;
+		vendor->name = add_string(builder, line + 6, len - 6);
+		return;
+	}
+	if (!*in_vendor || len <= 7 || line[1] == '\t' ||
+	    parse_hex(line + 1, 4, &id))
+		return;
+	builder->products = grow(builder->products, &builder->products_allocated,
+				 builder->nproducts + 1, sizeof(*product));
+	product = &builder->products[builder->nproducts++];
+	product->idVendor = builder->vendors[builder->nvendors - 1].idVendor;
+	product->idProduct = id;
+	product->name = add_string(builder, line + 7, len - 7);
+}
+
+static int compare_vendors(const void *a, const void *b)
+{
+	const struct ids_vendor *x = a;
+	const struct ids_vendor *y = b;
+
+	return (int)x->idVendor - (int)y->idVendor;
+}
+
+static int compare_products(const void *a, const void *b)
+{
+	const struct ids_product *x = a;
+	const struct ids_product *y = b;
+
+	if (x->idVendor != y->idVendor)
+		return (int)x->idVendor - (int)y->idVendor;
+	return (int)x->idProduct - (int)y->idProduct;
+}
+
+/* usb.ids is sorted already, but nothing says it has to stay that way */
+static void sort_ids(struct ids_builder *builder)
+{
+	u32 i;
+	u32 p = 0;
+
+	qsort(builder->vendors, builder->nvendors, sizeof(*builder->vendors),
+	      compare_vendors);
+	qsort(builder->products, builder->nproducts, sizeof(*builder->products),
+	      compare_products);
+	for (i = 0; i < builder->nvendors; i++) {
+		struct ids_vendor *vendor = &builder->vendors[i];
+
+		while (p < builder->nproducts &&
+		       builder->products[p].idVendor < vendor->idVendor)
+			p++;
+		vendor->products = p;
+		while (p < builder->nproducts &&
+		       builder->products[p].idVendor == vendor->idVendor)
+			p++;
+		vendor->nproducts = p - vendor->products;
+	}
+}
+
+static int parse_ids(struct ids_builder *builder, struct stat *st)
+{
+	char *text;
+	char *line;
+	char *end;
+	char *eol;
+	ssize_t retval;
+	size_t len = 0;
+	int in_vendor = 0;
+	int fd;
+
+	memset(builder, 0, sizeof(*builder));
+	fd = open(usb_ids_file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, st)) {
+		close(fd);
+		return -1;
+	}
+	text = malloc(st->st_size + 1);
+	if (text == NULL)
+		exit(1);
+	while (len < (size_t)st->st_size) {
+		retval = read(fd, text + len, st->st_size - len);
+		if (retval <= 0)
+			break;
+		len += retval;
+	}
+	close(fd);
+	text[len] = '\0';
+
+	end = text + len;
+	for (line = text; line < end; line = eol + 1) {
+		eol = memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		len = eol - line;
+		if (len > 0 && line[len - 1] == '\r')
+			len--;
+		parse_ids_line(builder, line, len, &in_vendor);
+	}
+	free(text);
+	sort_ids(builder);
+	return 0;
+}
+
+static int ids_index_stale(const struct ids_header *header)
+{
+	struct stat st;
+
+	/* no usb.ids at all, the index is all there is */
+	if (stat(usb_ids_file, &st))
+		return 0;
+	return header->ids_size != (u64)st.st_size ||
+	       header->ids_mtime != (s64)st.st_mtim.tv_sec ||
+	       header->ids_mtime_nsec != (u32)st.st_mtim.tv_nsec;
+}
+
+static int load_ids_index(void)
+{
+	const struct ids_header *header;
+	char filename[PATH_MAX];
+	const char *image;
+	struct stat st;
+	size_t size;
+	u32 i;
+	int fd;
+
+	index_name(filename, sizeof(filename));
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*header)) {
+		close(fd);
+		return -1;
+	}
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return -1;
+
+	header = (const struct ids_header *)image;
+	size = sizeof(*header) +
+	       (size_t)header->nvendors * sizeof(struct ids_vendor) +
+	       (size_t)header->nproducts * sizeof(struct ids_product) +
+	       header->strings_size;
+	if (memcmp(header->magic, IDS_INDEX_MAGIC, sizeof(header->magic)) ||
+	    header->version != IDS_INDEX_VERSION ||
+	    header->byte_order != IDS_INDEX_BYTE_ORDER ||
+	    size != (size_t)st.st_size || header->strings_size == 0 ||
+	    image[size - 1] != '\0' || ids_index_stale(header))
+		goto error;
+
+	ids.vendors = (const struct ids_vendor *)(header + 1);
+	ids.products = (const struct ids_product *)(ids.vendors + header->nvendors);
+	ids.strings = (const char *)(ids.products + header->nproducts);
+	ids.nvendors = header->nvendors;
+	ids.nproducts = header->nproducts;
+	ids.strings_size = header->strings_size;
+
+	/* the lookups trust the product ranges, so check them once up front */
+	for (i = 0; i < ids.nvendors; i++)
+		if (ids.vendors[i].products > ids.nproducts ||
+		    ids.nproducts - ids.vendors[i].products < ids.vendors[i].nproducts)
+			goto error;
+	return 0;
+
+error:
+	munmap((void *)image, st.st_size);
+	memset(&ids, 0, sizeof(ids));
+	return -1;
+}
+
+static void load_ids(void)
+{
+	struct ids_builder builder;
+	struct stat st;
+
+	ids_loaded = 1;
+	if (load_ids_index() == 0)
+		return;
+	if (parse_ids(&builder, &st))
+		return;
+	ids.vendors = builder.vendors;
+	ids.products = builder.products;
+	ids.strings = builder.strings;
+	ids.nvendors = builder.nvendors;
+	ids.nproducts = builder.nproducts;
+	ids.strings_size = builder.strings_size;
+}
+
+static const char *ids_string(u32 offset)
+{
+	return offset < ids.strings_size ? ids.strings + offset : NULL;
+}
+
+static const struct ids_vendor *find_vendor(u16 idVendor)
+{
+	struct ids_vendor key;
+
+	if (!ids_loaded)
+		load_ids();
+	if (ids.nvendors == 0)
+		return NULL;
+	key.idVendor = idVendor;
+	return bsearch(&key, ids.vendors, ids.nvendors, sizeof(key),
+		       compare_vendors);
+}
+
+const char *usb_vendor_name(u16 idVendor)
+{
+	const struct ids_vendor *vendor = find_vendor(idVendor);
+
+	return vendor ? ids_string(vendor->name) : NULL;
+}
+
+const char *usb_product_name(u16 idVendor, u16 idProduct)
+{
+	const struct ids_vendor *vendor = find_vendor(idVendor);
+	const struct ids_product *product;
+	struct ids_product key;
+
+	if (vendor == NULL || vendor->nproducts == 0)
+		return NULL;
+	key.idVendor = idVendor;
+	key.idProduct = idProduct;
+	product = bsearch(&key, ids.products + vendor->products,
+			  vendor->nproducts, sizeof(key), compare_products);
+	return product ? ids_string(product->name) : NULL;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t retval;
+
+	while (size > 0) {
+		retval = write(fd, p, size);
+		if (retval <= 0)
+			return -1;
+		p += retval;
+		size -= retval;
+	}
+	return 0;
+}
+
+/*
+ * Build the index for usb_ids_file.  It is written to a temporary file and
+ * renamed over the old one, so anyone who has the old one mapped keeps it.
+ */
+int compile_usb_ids(void)
+{
+	struct ids_builder builder;
+	struct ids_header header;
+	char filename[PATH_MAX];
+	char temp[PATH_MAX + 8];
+	struct stat st;
+	int retval;
+	int fd;
+
+	if (parse_ids(&builder, &st)) {
+		fprintf(stderr, "can't read %s: %s\n", usb_ids_file, strerror(errno));
+		return -1;
+	}
+	/* an index with nothing in it would look broken, give it one byte */
+	if (builder.strings_size == 0)
+		add_string(&builder, "", 0);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IDS_INDEX_MAGIC, sizeof(header.magic));
+	header.version = IDS_INDEX_VERSION;
+	header.byte_order = IDS_INDEX_BYTE_ORDER;
+	header.ids_size = st.st_size;
+	header.ids_mtime = st.st_mtim.tv_sec;
+	header.ids_mtime_nsec = st.st_mtim.tv_nsec;
+	header.nvendors = builder.nvendors;
+	header.nproducts = builder.nproducts;
+	header.strings_size = builder.strings_size;
+
+	index_name(filename, sizeof(filename));
+	snprintf(temp, sizeof(temp), "%s.XXXXXX", filename);
+	fd = mkstemp(temp);
+	if (fd == -1) {
+		fprintf(stderr, "can't create %s: %s\n", temp, strerror(errno));
+		return -1;
+	}
+	fchmod(fd, 0644);
+	retval = write_all(fd, &header, sizeof(header)) ||
+		 write_all(fd, builder.vendors,
+			   builder.nvendors * sizeof(*builder.vendors)) ||
+		 write_all(fd, builder.products,
+			   builder.nproducts * sizeof(*builder.products)) ||
+		 write_all(fd, builder.strings, builder.strings_size);
+	if (close(fd))
+		retval = -1;
+	if (retval == 0)
+		retval = rename(temp, filename);
+	if (retval) {
+		fprintf(stderr, "can't write %s: %s\n", filename, strerror(errno));
+		unlink(temp);
+	}
+	free(builder.vendors);
+	free(builder.products);
+	free(builder.strings);
+	return retval ? -1 : 0;
+}
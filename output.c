@@ -0,0 +1,672 @@
+/*
+ * output.c
+ *
+ * Format the device list into one big buffer and write() it out in as few
+ * pieces as possible.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+/*
+ * Listing thousands of devices should only be held up by whoever reads the
+ * output, so there is no stdio here: no locking, no format strings, and no
+ * allocations.  Everything goes into the buffer, numbers are turned into
+ * digits by hand, and the buffer is written out whenever it fills up.  Once
+ * a write fails (the reader went away) everything else is dropped.  The one
+ * exception is an outbuf with no fd, which grows a copy of all of it for the
+ * daemon to hand out at whatever speed its clients read.
+ */
+void out_init(struct outbuf *out, int fd)
+{
+	out->fd = fd;
+	out->error = 0;
+	out->records = 0;
+	out->len = 0;
+	out->mem = NULL;
+	out->mem_len = 0;
+	out->mem_size = 0;
+}
+
+/* with no fd to write to, the buffer goes on the end of out->mem instead */
+static void out_keep(struct outbuf *out)
+{
+	size_t size = out->mem_size ? out->mem_size : OUTBUF_SIZE;
+	char *mem;
+
+	while (size - out->mem_len < out->len)
+		size *= 2;
+	if (size != out->mem_size) {
+		mem = realloc(out->mem, size);
+		if (mem == NULL) {
+			out->error = 1;
+			return;
+		}
+		out->mem = mem;
+		out->mem_size = size;
+	}
+	memcpy(out->mem + out->mem_len, out->data, out->len);
+	out->mem_len += out->len;
+}
+
+int out_flush(struct outbuf *out)
+{
+	const char *data = out->data;
+	ssize_t retval;
+
+	if (out->fd == -1 && out->len > 0 && !out->error)
+		out_keep(out);
+	while (out->fd != -1 && out->len > 0 && !out->error) {
+		retval = write(out->fd, data, out->len);
+		if (retval < 0 && errno == EINTR)
+			continue;
+		if (retval <= 0) {
+			out->error = 1;
+			break;
+		}
+		data += retval;
+		out->len -= retval;
+	}
+	out->len = 0;
+	return out->error ? -1 : 0;
+}
+
+/*
+ * Everything an outbuf without an fd was given, for the caller to free(), or
+ * NULL if there was not the memory for it.
+ */
+char *out_take(struct outbuf *out, size_t *size)
+{
+	char *mem;
+
+	out_flush(out);
+	if (out->error) {
+		free(out->mem);
+		out->mem = NULL;
+		return NULL;
+	}
+	mem = out->mem;
+	*size = out->mem_len;
+	out->mem = NULL;
+	out->mem_len = 0;
+	out->mem_size = 0;
+	return mem;
+}
+
+/* make room for @size more bytes, @size has to fit in an empty buffer */
+static inline char *out_space(struct outbuf *out, size_t size)
+{
+	if (sizeof(out->data) - out->len < size)
+		out_flush(out);
+	return out->data + out->len;
+}
+
+void out_mem(struct outbuf *out, const char *data, size_t size)
+{
+	size_t chunk;
+
+	while (size > 0) {
+		if (out->len == sizeof(out->data))
+			out_flush(out);
+		chunk = sizeof(out->data) - out->len;
+		if (chunk > size)
+			chunk = size;
+		memcpy(out->data + out->len, data, chunk);
+		out->len += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+/* NULL comes out as "(null)", like printf() would have it */
+void out_str(struct outbuf *out, const char *string)
+{
+	if (string == NULL)
+		string = "(null)";
+	out_mem(out, string, strlen(string));
+}
+
+void out_char(struct outbuf *out, char c)
+{
+	*out_space(out, 1) = c;
+	out->len++;
+}
+
+/* at least @width digits, zero padded, "%0*lu" */
+void out_dec(struct outbuf *out, unsigned long value, unsigned int width)
+{
+	char digits[20];
+	unsigned int n = 0;
+	char *p;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	if (width > sizeof(digits))
+		width = sizeof(digits);
+	while (n < width)
+		digits[n++] = '0';
+
+	p = out_space(out, n);
+	out->len += n;
+	while (n > 0)
+		*p++ = digits[--n];
+}
+
+/* at least @width lower case hex digits, zero padded, "%0*lx" */
+void out_hex(struct outbuf *out, unsigned long value, unsigned int width)
+{
+	static const char hex[] = "0123456789abcdef";
+	char digits[16];
+	unsigned int n = 0;
+	char *p;
+
+	do {
+		digits[n++] = hex[value & 0xf];
+		value >>= 4;
+	} while (value);
+	if (width > sizeof(digits))
+		width = sizeof(digits);
+	while (n < width)
+		digits[n++] = '0';
+
+	p = out_space(out, n);
+	out->len += n;
+	while (n > 0)
+		*p++ = digits[--n];
+}
+
+/*
+ * The plain listing:
+ *
+ *	Bus 001 Device 002: ID 046d:c52b Logitech, Inc. Unifying Receiver
+ *		Intf 1-1:1.0 (usbhid)
+ */
+static void text_device_line(struct outbuf *out, struct usb_device *usb_device)
+{
+	const char *vendor;
+	const char *product;
+
+	usb_device_names(usb_device, &vendor, &product);
+	out_mem(out, "Bus ", 4);
+	out_dec(out, usb_device->busnum, 3);
+	out_mem(out, " Device ", 8);
+	out_dec(out, usb_device->devnum, 3);
+	out_mem(out, ": ID ", 5);
+	out_hex(out, usb_device->idVendor, 4);
+	out_char(out, ':');
+	out_hex(out, usb_device->idProduct, 4);
+	out_char(out, ' ');
+	out_str(out, vendor);
+	if (product) {
+		out_char(out, ' ');
+		out_str(out, product);
+	}
+	out_char(out, '\n');
+}
+
+static void text_device(struct outbuf *out, struct usb_device *usb_device)
+{
+	struct usb_interface *usb_interface;
+
+	text_device_line(out, usb_device);
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list) {
+		out_mem(out, "\tIntf ", 6);
+		out_str(out, usb_interface->sysname);
+		out_mem(out, " (", 2);
+		out_str(out, usb_interface->driver);
+		out_mem(out, ")\n", 2);
+	}
+}
+
+const struct usb_formatter text_formatter = {
+	.name		= "text",
+	.device		= text_device,
+};
+
+/*
+ * JSON.  Every device is one object with everything we know about it, its
+ * interfaces and their endpoints nested inside:
+ *
+ *	{"bus":1,"device":2,"sysname":"1-1","idVendor":"046d",...,
+ *	 "interfaces":[{"sysname":"1-1:1.0",...,"endpoints":[{...}]}]}
+ *
+ * Vendor and product ids, and BCD versions, are strings the way lsusb
+ * prints them, everything else is a plain number.  Strings we don't have
+ * are null.
+ */
+static void json_string(struct outbuf *out, const char *string)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p;
+	const unsigned char *start;
+
+	if (string == NULL) {
+		out_mem(out, "null", 4);
+		return;
+	}
+	out_char(out, '"');
+	start = (const unsigned char *)string;
+	for (p = start; *p; p++) {
+		if (*p >= 0x20 && *p != '"' && *p != '\\')
+			continue;
+		out_mem(out, (const char *)start, p - start);
+		start = p + 1;
+		if (*p == '"' || *p == '\\') {
+			out_char(out, '\\');
+			out_char(out, *p);
+		} else {
+			out_mem(out, "\\u00", 4);
+			out_char(out, hex[*p >> 4]);
+			out_char(out, hex[*p & 0xf]);
+		}
+	}
+	out_mem(out, (const char *)start, p - start);
+	out_char(out, '"');
+}
+
+/* ,"name": -- the first member of an object leaves out the comma */
+static void json_key(struct outbuf *out, const char *name, int first)
+{
+	if (!first)
+		out_char(out, ',');
+	out_char(out, '"');
+	out_str(out, name);
+	out_mem(out, "\":", 2);
+}
+
+static void json_number(struct outbuf *out, const char *name,
+			unsigned long value)
+{
+	json_key(out, name, 0);
+	out_dec(out, value, 0);
+}
+
+static void json_hex(struct outbuf *out, const char *name, unsigned int value)
+{
+	json_key(out, name, 0);
+	out_char(out, '"');
+	out_hex(out, value, 4);
+	out_char(out, '"');
+}
+
+static void json_bcd(struct outbuf *out, const char *name, unsigned int value)
+{
+	json_key(out, name, 0);
+	out_char(out, '"');
+	out_hex(out, value >> 8, 1);
+	out_char(out, '.');
+	out_hex(out, value & 0xff, 2);
+	out_char(out, '"');
+}
+
+static void json_text(struct outbuf *out, const char *name, const char *value)
+{
+	json_key(out, name, 0);
+	json_string(out, value);
+}
+
+static void json_endpoint(struct outbuf *out, const struct usb_endpoint *usb_endpoint)
+{
+	json_key(out, "bEndpointAddress", 1);
+	out_dec(out, usb_endpoint->bEndpointAddress, 0);
+	json_number(out, "bmAttributes", usb_endpoint->bmAttributes);
+	json_number(out, "wMaxPacketSize", usb_endpoint->wMaxPacketSize);
+	json_number(out, "bInterval", usb_endpoint->bInterval);
+	json_text(out, "direction", usb_endpoint_direction(usb_endpoint));
+	json_text(out, "type", usb_endpoint_type(usb_endpoint));
+}
+
+static void json_interface(struct outbuf *out,
+			   const struct usb_interface *usb_interface)
+{
+	struct usb_endpoint *usb_endpoint;
+	int first = 1;
+
+	json_key(out, "sysname", 1);
+	json_string(out, usb_interface->sysname);
+	json_text(out, "driver", usb_interface->driver);
+	json_number(out, "bInterfaceNumber", usb_interface->bInterfaceNumber);
+	json_number(out, "bAlternateSetting", usb_interface->bAlternateSetting);
+	json_number(out, "bInterfaceClass", usb_interface->bInterfaceClass);
+	json_number(out, "bInterfaceSubClass", usb_interface->bInterfaceSubClass);
+	json_number(out, "bInterfaceProtocol", usb_interface->bInterfaceProtocol);
+	json_number(out, "bNumEndpoints", usb_interface->bNumEndpoints);
+	json_key(out, "endpoints", 0);
+	out_char(out, '[');
+	list_for_each_entry(usb_endpoint, &usb_interface->endpoints, list) {
+		out_mem(out, first ? "{" : ",{", first ? 1 : 2);
+		json_endpoint(out, usb_endpoint);
+		out_char(out, '}');
+		first = 0;
+	}
+	out_char(out, ']');
+}
+
+static void json_qualifier(struct outbuf *out,
+			   const struct usb_device_qualifier *qualifier)
+{
+	json_key(out, "bcdUSB", 1);
+	out_char(out, '"');
+	out_hex(out, qualifier->bcdUSB >> 8, 1);
+	out_char(out, '.');
+	out_hex(out, qualifier->bcdUSB & 0xff, 2);
+	out_char(out, '"');
+	json_number(out, "bDeviceClass", qualifier->bDeviceClass);
+	json_number(out, "bDeviceSubClass", qualifier->bDeviceSubClass);
+	json_number(out, "bDeviceProtocol", qualifier->bDeviceProtocol);
+	json_number(out, "bMaxPacketSize0", qualifier->bMaxPacketSize0);
+	json_number(out, "bNumConfigurations", qualifier->bNumConfigurations);
+}
+
+static void json_device(struct outbuf *out, struct usb_device *usb_device)
+{
+	struct usb_interface *usb_interface;
+	const char *vendor;
+	const char *product;
+	int first = 1;
+
+	load_usb_device_all(usb_device);
+	/* only what usb.ids says, the device's own strings have keys of their own */
+	vendor = usb_vendor_name(usb_device->idVendor);
+	product = usb_product_name(usb_device->idVendor, usb_device->idProduct);
+	json_key(out, "bus", 1);
+	out_dec(out, usb_device->busnum, 0);
+	json_number(out, "device", usb_device->devnum);
+	json_text(out, "sysname", usb_device->sysname);
+	json_hex(out, "idVendor", usb_device->idVendor);
+	json_hex(out, "idProduct", usb_device->idProduct);
+	json_text(out, "vendor_name", vendor);
+	json_text(out, "product_name", product);
+	json_text(out, "manufacturer", usb_device->manufacturer);
+	json_text(out, "product", usb_device->product);
+	json_text(out, "serial", usb_device->serial);
+	json_text(out, "driver", usb_device->driver);
+	json_bcd(out, "bcdUSB", usb_device->version);
+	json_bcd(out, "bcdDevice", usb_device->bcdDevice);
+	json_number(out, "speed", usb_device->speed);
+	json_number(out, "bDeviceClass", usb_device->bDeviceClass);
+	json_number(out, "bDeviceSubClass", usb_device->bDeviceSubClass);
+	json_number(out, "bDeviceProtocol", usb_device->bDeviceProtocol);
+	json_number(out, "bMaxPacketSize0", usb_device->bMaxPacketSize0);
+	json_number(out, "bNumConfigurations", usb_device->bNumConfigurations);
+	json_number(out, "bConfigurationValue", usb_device->bConfigurationValue);
+	json_number(out, "bNumInterfaces", usb_device->bNumInterfaces);
+	json_number(out, "bmAttributes", usb_device->bmAttributes);
+	json_number(out, "bMaxPower", usb_device->bMaxPower);
+	json_number(out, "maxchild", usb_device->maxchild);
+	json_number(out, "quirks", usb_device->quirks);
+
+	json_key(out, "ep0", 0);
+	if (usb_device->ep0) {
+		out_char(out, '{');
+		json_endpoint(out, usb_device->ep0);
+		out_char(out, '}');
+	} else {
+		out_mem(out, "null", 4);
+	}
+	json_key(out, "qualifier", 0);
+	if (usb_device->qualifier) {
+		out_char(out, '{');
+		json_qualifier(out, usb_device->qualifier);
+		out_char(out, '}');
+	} else {
+		out_mem(out, "null", 4);
+	}
+
+	json_key(out, "interfaces", 0);
+	out_char(out, '[');
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list) {
+		out_mem(out, first ? "{" : ",{", first ? 1 : 2);
+		json_interface(out, usb_interface);
+		out_char(out, '}');
+		first = 0;
+	}
+	out_char(out, ']');
+}
+
+/* --json: one array, a device per line */
+static void json_begin(struct outbuf *out, struct lsusb_snapshot *snapshot,
+		       const struct usb_filter *filter)
+{
+	(void)snapshot;
+	(void)filter;
+	out_char(out, '[');
+}
+
+static void json_array_device(struct outbuf *out,
+			      struct usb_device *usb_device)
+{
+	if (out->records++)
+		out_char(out, ',');
+	out_mem(out, "\n{", 2);
+	json_device(out, usb_device);
+	out_char(out, '}');
+}
+
+static void json_end(struct outbuf *out)
+{
+	if (out->records)
+		out_char(out, '\n');
+	out_mem(out, "]\n", 2);
+}
+
+const struct usb_formatter json_formatter = {
+	.name		= "json",
+	.device_attrs	= USB_ATTRS_ALL,
+	.interface_attrs = USB_ATTRS_ALL,
+	.begin		= json_begin,
+	.device		= json_array_device,
+	.end		= json_end,
+};
+
+/* --ndjson: one object per line, and nothing around them */
+static void ndjson_device(struct outbuf *out, struct usb_device *usb_device)
+{
+	out_char(out, '{');
+	json_device(out, usb_device);
+	out_mem(out, "}\n", 2);
+	out->records++;
+}
+
+const struct usb_formatter ndjson_formatter = {
+	.name		= "ndjson",
+	.device_attrs	= USB_ATTRS_ALL,
+	.interface_attrs = USB_ATTRS_ALL,
+	.device		= ndjson_device,
+};
+
+/*
+ * -t: the devices the way they hang off of each other, a line for each
+ * interface:
+ *
+ *	/:  Bus 001.Port 001: Dev 001, Driver=hub/4p, 480M
+ *	    |__ Port 002: Dev 003, If 0, Driver=usbhid, 12M
+ *	    |__ Port 002: Dev 003, If 1, Driver=usbhid, 12M
+ *
+ * Each root (or a device whose hub is not on the list, or did not get past
+ * the filter) prints its subtree when it comes up, everything else was
+ * printed by then.  Only the devices the filter lets through are in it, the
+ * same ones the other formats list, and interfaces go by their number.
+ */
+static const struct usb_filter *tree_filter;
+
+/* kbit/s as "1.5M", "12M", "480M", ... */
+static void tree_speed(struct outbuf *out, u32 speed)
+{
+	if (speed == 0) {
+		out_char(out, '?');
+		return;
+	}
+	out_dec(out, speed / 1000, 0);
+	if (speed % 1000) {
+		out_char(out, '.');
+		out_dec(out, speed % 1000 / 100, 0);
+	}
+	out_char(out, 'M');
+}
+
+/* the lowest interface number above @after, or -1 when there is none */
+static int tree_next_ifnum(struct usb_device *usb_device, int after)
+{
+	struct usb_interface *usb_interface;
+	int ifnum = -1;
+
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+		if (usb_interface->bInterfaceNumber > after &&
+		    (ifnum == -1 || usb_interface->bInterfaceNumber < ifnum))
+			ifnum = usb_interface->bInterfaceNumber;
+	return ifnum;
+}
+
+static int is_root_hub(const struct usb_device *usb_device)
+{
+	return strncmp(usb_device->sysname, "usb", 3) == 0;
+}
+
+static void tree_line(struct outbuf *out, struct usb_device *usb_device,
+		      unsigned int depth, const struct usb_interface *usb_interface)
+{
+	const char *driver = NULL;
+	unsigned int i;
+
+	if (depth == 0) {
+		out_mem(out, "/:  Bus ", 8);
+		out_dec(out, usb_device->busnum, 3);
+		out_char(out, '.');
+	} else {
+		for (i = 0; i < depth; i++)
+			out_mem(out, "    ", 4);
+		out_mem(out, "|__ ", 4);
+	}
+	out_mem(out, "Port ", 5);
+	out_dec(out, usb_device->portnum, 3);
+	out_mem(out, ": Dev ", 6);
+	out_dec(out, usb_device->devnum, 3);
+	if (usb_interface) {
+		if (!is_root_hub(usb_device)) {
+			out_mem(out, ", If ", 5);
+			out_dec(out, usb_interface->bInterfaceNumber, 0);
+		}
+		driver = usb_interface->driver;
+	}
+	if (usb_interface || usb_device->maxchild) {
+		out_mem(out, ", Driver=", 9);
+		out_str(out, driver ? driver : "[none]");
+	}
+	if (usb_device->maxchild) {
+		out_char(out, '/');
+		out_dec(out, usb_device->maxchild, 0);
+		out_char(out, 'p');
+	}
+	out_mem(out, ", ", 2);
+	tree_speed(out, usb_device->speed);
+	out_char(out, '\n');
+}
+
+static void tree_device_depth(struct outbuf *out, struct usb_device *usb_device,
+			      unsigned int depth)
+{
+	struct usb_interface *usb_interface;
+	struct usb_device *child;
+	int ifnum;
+
+	load_usb_device(usb_device, USB_DEVICE_TREE);
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+		load_usb_interface(usb_device, usb_interface,
+				   USB_ATTR(INTERFACE_NUMBER));
+	if (list_empty(&usb_device->interfaces))
+		tree_line(out, usb_device, depth, NULL);
+	/* a hub only has the one interface, the root hub line says it all */
+	for (ifnum = tree_next_ifnum(usb_device, -1); ifnum != -1;
+	     ifnum = tree_next_ifnum(usb_device, ifnum)) {
+		list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+			if (usb_interface->bInterfaceNumber == ifnum)
+				tree_line(out, usb_device, depth, usb_interface);
+		if (is_root_hub(usb_device))
+			break;
+	}
+	list_for_each_entry(child, &usb_device->children, sibling)
+		if (match_usb_device(tree_filter, child))
+			tree_device_depth(out, child, depth + 1);
+}
+
+static void tree_begin(struct outbuf *out, struct lsusb_snapshot *snapshot,
+		       const struct usb_filter *filter)
+{
+	(void)out;
+	tree_filter = filter;
+	link_usb_devices(snapshot);
+}
+
+static void tree_device(struct outbuf *out, struct usb_device *usb_device)
+{
+	if (usb_device->parent == NULL ||
+	    !match_usb_device(tree_filter, usb_device->parent))
+		tree_device_depth(out, usb_device, 0);
+}
+
+const struct usb_formatter tree_formatter = {
+	.name		= "tree",
+	.device_attrs	= USB_DEVICE_TREE,
+	.interface_attrs = USB_ATTR(INTERFACE_NUMBER),
+	.begin		= tree_begin,
+	.device		= tree_device,
+};
+
+/*
+ * -v: the listing line, then every descriptor the device has, field by
+ * field, see decode.c
+ */
+static void verbose_device(struct outbuf *out, struct usb_device *usb_device)
+{
+	if (out->records++)
+		out_char(out, '\n');
+	text_device_line(out, usb_device);
+	load_usb_device(usb_device, USB_ATTR(DEVICE_DESCRIPTORS) |
+				    USB_ATTR(DEVICE_SPEED));
+	decode_usb_descriptors(out, usb_device->descriptors,
+			       usb_device->descriptors_size, usb_device->speed);
+}
+
+const struct usb_formatter verbose_formatter = {
+	.name		= "verbose",
+	.device_attrs	= USB_ATTR(DEVICE_DESCRIPTORS) | USB_ATTR(DEVICE_SPEED),
+	.device		= verbose_device,
+};
+
+static const struct usb_formatter * const usb_formatters[] = {
+	&text_formatter,
+	&json_formatter,
+	&ndjson_formatter,
+	&tree_formatter,
+	&verbose_formatter,
+};
+
+const struct usb_formatter *find_usb_formatter(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(usb_formatters); i++)
+		if (strcmp(usb_formatters[i]->name, name) == 0)
+			return usb_formatters[i];
+	return NULL;
+}
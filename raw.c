@@ -28,168 +28,282 @@
 #include <sys/select.h>
 #include <sys/stat.h>
 
-#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
-
-#include <libudev.h>
 #include "list.h"
 #include "usb.h"
 #include "lsusb.h"
 
 
-static void parse_config_descriptor(const unsigned char *descriptor)
+/*
+ * Where we are in the descriptor blob: interfaces belong to the config
+ * before them, and endpoints to the interface before them.
+ */
+struct descriptor_state {
+	struct usb_device *usb_device;
+	struct usb_config *config;
+	struct usb_interface *interface;
+};
+
+/* what the device descriptor fills in, see load_usb_device() */
+#define USB_DEVICE_DESCRIPTOR	(USB_ATTR(DEVICE_VERSION) |		\
+				 USB_ATTR(DEVICE_CLASS) |		\
+				 USB_ATTR(DEVICE_SUBCLASS) |		\
+				 USB_ATTR(DEVICE_PROTOCOL) |		\
+				 USB_ATTR(DEVICE_MAX_PACKET_SIZE0) |	\
+				 USB_ATTR(DEVICE_IDVENDOR) |		\
+				 USB_ATTR(DEVICE_IDPRODUCT) |		\
+				 USB_ATTR(DEVICE_BCDDEVICE) |		\
+				 USB_ATTR(DEVICE_NUM_CONFIGURATIONS))
+
+/* and what the active config descriptor does */
+#define USB_DEVICE_CONFIG	(USB_ATTR(DEVICE_NUM_INTERFACES) |	\
+				 USB_ATTR(DEVICE_ATTRIBUTES) |		\
+				 USB_ATTR(DEVICE_MAX_POWER))
+
+/*
+ * Normally everything in here comes from sysfs, only in descriptor mode do
+ * we take it from the raw device descriptor instead.
+ */
+static void parse_device_descriptor(struct descriptor_state *state,
+				    const unsigned char *descriptor)
 {
-	struct usb_config config;
-
-	config.bLength			= descriptor[0];
-	config.bDescriptorType		= descriptor[1];
-	config.wTotalLength		= (descriptor[3] << 8) | descriptor[2];
-	config.bNumInterfaces		= descriptor[4];
-	config.bConfigurationValue	= descriptor[5];
-	config.iConfiguration		= descriptor[6];
-	config.bmAttributes		= descriptor[7];
-	config.bMaxPower		= descriptor[8];
+	struct usb_device *usb_device = state->usb_device;
+
+	if (!descriptor_mode)
+		return;
+	usb_device->version		= (descriptor[3] << 8) | descriptor[2];
+	usb_device->bDeviceClass	= descriptor[4];
+	usb_device->bDeviceSubClass	= descriptor[5];
+	usb_device->bDeviceProtocol	= descriptor[6];
+	usb_device->bMaxPacketSize0	= descriptor[7];
+	usb_device->idVendor		= (descriptor[9] << 8) | descriptor[8];
+	usb_device->idProduct		= (descriptor[11] << 8) | descriptor[10];
+	usb_device->bcdDevice		= (descriptor[13] << 8) | descriptor[12];
+	usb_device->bNumConfigurations	= descriptor[17];
+	usb_device->loaded		|= USB_DEVICE_DESCRIPTOR;
+}
+
+/*
+ * The configs, interfaces and endpoints are only wanted in descriptor mode,
+ * where they stand in for what would otherwise come out of sysfs.  -v works
+ * on the raw copy of the descriptors instead.
+ */
+static void parse_config_descriptor(struct descriptor_state *state,
+				    const unsigned char *descriptor)
+{
+	struct usb_config *config;
+
+	if (!descriptor_mode)
+		return;
+	config = robust_malloc(sizeof(struct usb_config));
+	INIT_LIST_HEAD(&config->interfaces);
+
+	config->bLength			= descriptor[0];
+	config->bDescriptorType		= descriptor[1];
+	config->wTotalLength		= (descriptor[3] << 8) | descriptor[2];
+	config->bNumInterfaces		= descriptor[4];
+	config->bConfigurationValue	= descriptor[5];
+	config->iConfiguration		= descriptor[6];
+	config->bmAttributes		= descriptor[7];
+	config->bMaxPower		= descriptor[8];
 #if 0
 	printf("Config descriptor\n");
-	printf("\tbLength\t\t\t%d\n", config.bLength);
-	printf("\tbDescriptorType\t\t%d\n", config.bDescriptorType);
-	printf("\twTotalLength\t\t%d\n", config.wTotalLength);
-	printf("\tbNumInterfaces\t\t%d\n", config.bNumInterfaces);
-	printf("\tbConfigurationValue\t%d\n", config.bConfigurationValue);
-	printf("\tiConfiguration\t\t%d\n", config.iConfiguration);
-	printf("\tbmAttributes\t\t0x%02x\n", config.bmAttributes);
-	printf("\tbMaxPower\t\t%d\n", config.bMaxPower);
+	printf("\tbLength\t\t\t%d\n", config->bLength);
+	printf("\tbDescriptorType\t\t%d\n", config->bDescriptorType);
+	printf("\twTotalLength\t\t%d\n", config->wTotalLength);
+	printf("\tbNumInterfaces\t\t%d\n", config->bNumInterfaces);
+	printf("\tbConfigurationValue\t%d\n", config->bConfigurationValue);
+	printf("\tiConfiguration\t\t%d\n", config->iConfiguration);
+	printf("\tbmAttributes\t\t0x%02x\n", config->bmAttributes);
+	printf("\tbMaxPower\t\t%d\n", config->bMaxPower);
 #endif
+	list_add_tail(&config->list, &state->usb_device->configs);
+	state->config = config;
+	state->interface = NULL;
 }
 
-static void parse_interface_descriptor(const unsigned char *descriptor)
+static void parse_interface_descriptor(struct descriptor_state *state,
+				       const unsigned char *descriptor)
 {
-	unsigned char bLength			= descriptor[0];
-	unsigned char bDescriptorType		= descriptor[1];
-	unsigned char bInterfaceNumber		= descriptor[2];
-	unsigned char bAlternateSetting		= descriptor[3];
-	unsigned char bNumEndpoints		= descriptor[4];
-	unsigned char bInterfaceClass		= descriptor[5];
-	unsigned char bInterfaceSubClass	= descriptor[6];
-	unsigned char bInterfaceProtocol	= descriptor[7];
-	unsigned char iInterface		= descriptor[8];
+	struct usb_interface *usb_intf;
+
+	/* an interface outside of a config makes no sense, skip it */
+	if (!descriptor_mode || state->config == NULL)
+		return;
+
+	usb_intf = robust_malloc(sizeof(struct usb_interface));
+	INIT_LIST_HEAD(&usb_intf->list);
+	INIT_LIST_HEAD(&usb_intf->config_list);
+	INIT_LIST_HEAD(&usb_intf->endpoints);
+
+	usb_intf->bInterfaceNumber	= descriptor[2];
+	usb_intf->bAlternateSetting	= descriptor[3];
+	usb_intf->bNumEndpoints		= descriptor[4];
+	usb_intf->bInterfaceClass	= descriptor[5];
+	usb_intf->bInterfaceSubClass	= descriptor[6];
+	usb_intf->bInterfaceProtocol	= descriptor[7];
+	usb_intf->configuration		= state->config->bConfigurationValue;
+	usb_intf->ifnum			= usb_intf->bInterfaceNumber;
 #if 0
 	printf("Interface descriptor\n");
-	printf("\tbLength\t\t\t%d\n", bLength);
-	printf("\tbDescriptorType\t\t%d\n", bDescriptorType);
-	printf("\tbInterfaceNumber\t%d\n", bInterfaceNumber);
-	printf("\tbAlternateSetting\t%d\n", bAlternateSetting);
-	printf("\tbNumEndpoints\t\t%d\n", bNumEndpoints);
-	printf("\tbInterfaceClass\t\t%d\n", bInterfaceClass);
-	printf("\tbInterfaceSubClass\t%d\n", bInterfaceSubClass);
-	printf("\tbInterfaceProtocol\t%d\n", bInterfaceProtocol);
-	printf("\tiInterface\t\t%d\n", iInterface);
+	printf("\tbLength\t\t\t%d\n", descriptor[0]);
+	printf("\tbDescriptorType\t\t%d\n", descriptor[1]);
+	printf("\tbInterfaceNumber\t%d\n", usb_intf->bInterfaceNumber);
+	printf("\tbAlternateSetting\t%d\n", usb_intf->bAlternateSetting);
+	printf("\tbNumEndpoints\t\t%d\n", usb_intf->bNumEndpoints);
+	printf("\tbInterfaceClass\t\t%d\n", usb_intf->bInterfaceClass);
+	printf("\tbInterfaceSubClass\t%d\n", usb_intf->bInterfaceSubClass);
+	printf("\tbInterfaceProtocol\t%d\n", usb_intf->bInterfaceProtocol);
+	printf("\tiInterface\t\t%d\n", descriptor[8]);
 #endif
+	list_add_tail(&usb_intf->config_list, &state->config->interfaces);
+	state->interface = usb_intf;
 }
 
-static void parse_endpoint_descriptor(const unsigned char *descriptor)
+static void parse_endpoint_descriptor(struct descriptor_state *state,
+				      const unsigned char *descriptor)
 {
-	unsigned char bLength			= descriptor[0];
-	unsigned char bDescriptorType		= descriptor[1];
-	unsigned char bEndpointAddress		= descriptor[2];
-	unsigned char bmAttributes		= descriptor[3];
-	unsigned short wMaxPacketSize		= (descriptor[5] << 8) | descriptor[4];
-	unsigned char bInterval			= descriptor[6];
+	struct usb_endpoint *ep;
+
+	if (!descriptor_mode || state->interface == NULL)
+		return;
+
+	ep = robust_malloc(sizeof(struct usb_endpoint));
+	ep->bLength		= descriptor[0];
+	ep->bEndpointAddress	= descriptor[2];
+	ep->bmAttributes	= descriptor[3];
+	ep->wMaxPacketSize	= (descriptor[5] << 8) | descriptor[4];
+	ep->bInterval		= descriptor[6];
 #if 0
 	printf("Endpoint descriptor\n");
-	printf("\tbLength\t\t\t%d\n", bLength);
-	printf("\tbDescriptorType\t\t%d\n", bDescriptorType);
-	printf("\tbEndpointAddress\t%0x\n", bEndpointAddress);
-	printf("\tbmAtributes\t\t%0x\n", bmAttributes);
-	printf("\twMaxPacketSize\t\t%d\n", wMaxPacketSize);
-	printf("\tbInterval\t\t%d\n", bInterval);
+	printf("\tbLength\t\t\t%d\n", ep->bLength);
+	printf("\tbDescriptorType\t\t%d\n", descriptor[1]);
+	printf("\tbEndpointAddress\t%0x\n", ep->bEndpointAddress);
+	printf("\tbmAtributes\t\t%0x\n", ep->bmAttributes);
+	printf("\twMaxPacketSize\t\t%d\n", ep->wMaxPacketSize);
+	printf("\tbInterval\t\t%d\n", ep->bInterval);
 #endif
+	list_add_tail(&ep->list, &state->interface->endpoints);
 }
 
 static void parse_device_qualifier(struct usb_device *usb_device, const unsigned char *descriptor)
 {
 	struct usb_device_qualifier *dq;
-	char string[255];
-	unsigned char bLength			= descriptor[0];
-	unsigned char bDescriptorType		= descriptor[1];
-	unsigned char bcdUSB0			= descriptor[3];
-	unsigned char bcdUSB1			= descriptor[2];
-	unsigned char bDeviceClass		= descriptor[4];
-	unsigned char bDeviceSubClass		= descriptor[5];
-	unsigned char bDeviceProtocol		= descriptor[6];
-	unsigned char bMaxPacketSize0		= descriptor[7];
-	unsigned char bNumConfigurations	= descriptor[8];
 
 	dq = robust_malloc(sizeof(struct usb_device_qualifier));
 
-#define build_string(name)		\
-	sprintf(string, "%d", name);	\
-	dq->name = strdup(string);
-
-	build_string(bLength);
-	build_string(bDescriptorType);
-	build_string(bDeviceClass);
-	build_string(bDeviceSubClass);
-	build_string(bDeviceProtocol);
-	build_string(bMaxPacketSize0);
-	build_string(bNumConfigurations);
-	sprintf(string, "%2x.%2x", bcdUSB0, bcdUSB1);
-	dq->bcdUSB = strdup(string);
+	dq->bLength		= descriptor[0];
+	dq->bDescriptorType	= descriptor[1];
+	dq->bcdUSB		= (descriptor[3] << 8) | descriptor[2];
+	dq->bDeviceClass	= descriptor[4];
+	dq->bDeviceSubClass	= descriptor[5];
+	dq->bDeviceProtocol	= descriptor[6];
+	dq->bMaxPacketSize0	= descriptor[7];
+	dq->bNumConfigurations	= descriptor[8];
 
 	usb_device->qualifier = dq;
+}
+
+/*
+ * The sysfs "descriptors" file is the device descriptor followed by all of
+ * the config descriptors the kernel cached, so it is small enough to pull in
+ * with one read() and then walk in place.  Only if the first buffer fills up
+ * do we fall back to growing a heap buffer.
+ */
+#define DESCRIPTOR_BUFFER_SIZE	4096
+
+struct descriptor_cursor {
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+};
+
+/*
+ * Return a pointer to the next descriptor in the buffer, or NULL if we are at
+ * the end or the length byte would take us past the end of the data.
+ */
+static const unsigned char *next_descriptor(struct descriptor_cursor *cursor)
+{
+	const unsigned char *descriptor;
+	size_t remaining = cursor->size - cursor->offset;
 
-	printf("Device Qualifier\n");
-	printf("\tbLength\t\t\t%s\n", dq->bLength);
-	printf("\tbDescriptorType\t\t%s\n", dq->bDescriptorType);
-	printf("\tbcdUSB\t\t%s", dq->bcdUSB);
+	/* we need at least bLength and bDescriptorType */
+	if (remaining < 2)
+		return NULL;
+	descriptor = &cursor->data[cursor->offset];
+	if (descriptor[0] < 2 || descriptor[0] > remaining)
+		return NULL;
+	cursor->offset += descriptor[0];
+	return descriptor;
 }
 
-void read_raw_usb_descriptor(struct udev_device *device, struct usb_device *usb_device)
+/*
+ * The device's bNumInterfaces, bmAttributes and bMaxPower in sysfs are those
+ * of the config it is in, so take them from the same one here.
+ */
+static void use_active_config(struct usb_device *usb_device)
 {
-	char filename[PATH_MAX];
-	int file;
-	unsigned char *data;
-	unsigned char size;
-	ssize_t read_retval;
+	struct usb_config *config;
+	unsigned int unit;
+
+	list_for_each_entry(config, &usb_device->configs, list) {
+		if (config->bConfigurationValue != usb_device->bConfigurationValue)
+			continue;
+		unit = USB_POWER_UNIT(usb_device->speed);
+		usb_device->bNumInterfaces	= config->bNumInterfaces;
+		usb_device->bmAttributes	= config->bmAttributes;
+		usb_device->bMaxPower		= config->bMaxPower * unit;
+		usb_device->loaded		|= USB_DEVICE_CONFIG;
+		return;
+	}
+}
 
-	sprintf(filename, "%s/descriptors", udev_device_get_syspath(device));
+/*
+ * Everything in here has to hold up to whatever is in @data, it is only as
+ * good as the device that sent it.  bench/fuzz-descriptors.c makes sure.
+ */
+void parse_raw_usb_descriptors(struct usb_device *usb_device,
+			       const unsigned char *data, size_t size)
+{
+	struct descriptor_cursor cursor = {
+		.data	= data,
+		.size	= size,
+		.offset	= 0,
+	};
+	struct descriptor_state state = {
+		.usb_device	= usb_device,
+	};
+	const unsigned char *descriptor;
 
-	file = open(filename, O_RDONLY);
-	if (file == -1)
-		exit(1);
-	while (1) {
-		read_retval = read(file, &size, 1);
-		if (read_retval != 1)
-			break;
-		data = malloc(size);
-		data[0] = size;
-		read_retval = read(file, &data[1], size-1);
-		switch (data[1]) {
+	while ((descriptor = next_descriptor(&cursor)) != NULL) {
+		switch (descriptor[1]) {
 		case 0x01:
 			/* device descriptor */
-			/*
-			 * We get all of this information from sysfs, so no
-			 * need to do any parsing here of the raw data.
-			 */
+			if (descriptor[0] >= 18)
+				parse_device_descriptor(&state, descriptor);
 			break;
 		case 0x02:
 			/* config descriptor */
-			parse_config_descriptor(data);
+			if (descriptor[0] >= 9)
+				parse_config_descriptor(&state, descriptor);
 			break;
 		case 0x03:
 			/* string descriptor */
-//			parse_string_descriptor(data);
+//			parse_string_descriptor(descriptor);
 			break;
 		case 0x04:
 			/* interface descriptor */
-			parse_interface_descriptor(data);
+			if (descriptor[0] >= 9)
+				parse_interface_descriptor(&state, descriptor);
 			break;
 		case 0x05:
 			/* endpoint descriptor */
-			parse_endpoint_descriptor(data);
+			if (descriptor[0] >= 7)
+				parse_endpoint_descriptor(&state, descriptor);
 			break;
 		case 0x06:
 			/* device qualifier */
-			parse_device_qualifier(usb_device, data);
+			if (descriptor[0] >= 9)
+				parse_device_qualifier(usb_device, descriptor);
 			break;
 		case 0x07:
 			/* other speed config */
@@ -200,8 +314,101 @@ void read_raw_usb_descriptor(struct udev_device *device, struct usb_device *usb_
 		default:
 			break;
 		}
-		free(data);
+	}
+	if (descriptor_mode)
+		use_active_config(usb_device);
+}
+
+/*
+ * Read all of the "descriptors" file into @buffer, or into a bigger one from
+ * malloc() if it does not fit, which is then left in *@data.  Returns the size,
+ * or -1 if the device went away.
+ */
+static ssize_t read_descriptors_file(struct sysfs_dev *device,
+				     unsigned char *buffer, unsigned char **data_out)
+{
+	unsigned char *data = buffer;
+	size_t allocated = DESCRIPTOR_BUFFER_SIZE;
+	size_t size;
+	ssize_t read_retval;
+	int file;
+
+	*data_out = buffer;
+	file = open_dev_file(device, "descriptors");
+	if (file == -1)
+		return -1;
+	count_stat(STAT_READS, 1);
+	read_retval = read(file, data, allocated);
+	if (read_retval < 0)
+		read_retval = 0;
+	size = read_retval;
+
+	/* Huge composite device, keep going until we hit the end */
+	while (size == allocated) {
+		unsigned char *bigger;
+
+		/* scratch space only, so don't waste the scan arena on it */
+		bigger = malloc(allocated * 2);
+		if (bigger == NULL)
+			exit(1);
+		memcpy(bigger, data, size);
+		if (data != buffer)
+			free(data);
+		data = bigger;
+		allocated *= 2;
+		count_stat(STAT_READS, 1);
+		read_retval = read(file, &data[size], allocated - size);
+		if (read_retval <= 0)
+			break;
+		size += read_retval;
 	}
 	close(file);
+	count_stat(STAT_READ_BYTES, size);
+	*data_out = data;
+	return size;
+}
+
+/* a copy of the whole file, for lsusb -v to take apart */
+static void keep_raw_usb_descriptor(struct usb_device *usb_device,
+				    const unsigned char *data, size_t size)
+{
+	if (size == 0)
+		return;
+	usb_device->descriptors = robust_malloc(size);
+	memcpy(usb_device->descriptors, data, size);
+	usb_device->descriptors_size = size;
+}
+
+/* fails only if the device went away */
+int read_raw_usb_descriptor(struct sysfs_dev *device, struct usb_device *usb_device)
+{
+	unsigned char buffer[DESCRIPTOR_BUFFER_SIZE];
+	unsigned char *data;
+	ssize_t size;
+
+	size = read_descriptors_file(device, buffer, &data);
+	if (size < 0)
+		return -1;
+
+	parse_raw_usb_descriptors(usb_device, data, size);
+	if (usb_device->loaded & USB_ATTR(DEVICE_DESCRIPTORS))
+		keep_raw_usb_descriptor(usb_device, data, size);
+
+	if (data != buffer)
+		free(data);
+	return 0;
 }
 
+/* just the copy, for a device that was built without one */
+void load_raw_usb_descriptor(struct sysfs_dev *device, struct usb_device *usb_device)
+{
+	unsigned char buffer[DESCRIPTOR_BUFFER_SIZE];
+	unsigned char *data;
+	ssize_t size;
+
+	size = read_descriptors_file(device, buffer, &data);
+	if (size > 0)
+		keep_raw_usb_descriptor(usb_device, data, size);
+	if (data != buffer)
+		free(data);
+}
@@ -0,0 +1,675 @@
+/*
+ * snapshot.c
+ *
+ * Save everything a scan found to a file, and load it back in again without
+ * going anywhere near sysfs.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+
+
+/*
+ * A snapshot is the structures from usb.h exactly as they sit in memory,
+ * with every pointer turned into an offset from the start of the file (0 is
+ * still NULL), followed by a table of every object in it and what it is.
+ * Loading it is an mmap() and adding the address it got mapped at to each
+ * pointer, like a dynamic linker does, and then the devices can go straight
+ * on the list.
+ *
+ * That only works if the reader lays the structures out the same way as the
+ * writer did, so the header has the sizes of everything in it, and the
+ * version has to be bumped whenever usb.h changes.
+ *
+ * Nothing in the file is trusted: the loader knows where the pointers are in
+ * each type of object, and each one has to point at the right type of object
+ * in the file before it is used.
+ */
+#define SNAPSHOT_MAGIC		"LSUSBSNP"
+#define SNAPSHOT_VERSION	6
+#define SNAPSHOT_BYTE_ORDER	0x01020304
+
+struct snapshot_header {
+	char magic[8];
+	u32 version;
+	u32 byte_order;
+	u32 header_size;
+	u32 pointer_size;
+	u32 device_size;
+	u32 interface_size;
+	u32 config_size;
+	u32 endpoint_size;
+	u32 qualifier_size;
+	u32 ndevices;
+	u64 size;		/* of the whole file */
+	u64 objects;		/* where the table of objects starts */
+	u64 nobjects;
+	struct list_head devices;
+};
+
+enum snapshot_type {
+	SNAP_HEADER,
+	SNAP_STRING,
+	SNAP_DEVICE,
+	SNAP_INTERFACE,
+	SNAP_CONFIG,
+	SNAP_ENDPOINT,
+	SNAP_QUALIFIER,
+	SNAP_DATA,
+	NR_SNAP_TYPES,
+};
+
+/* one for each object, in the order they are in the file */
+struct snapshot_entry {
+	u64 offset;
+	u32 size;
+	u32 type;
+};
+
+/*
+ * A pointer has to point at the start of an object of @type, or for a list
+ * at the list_head @field in it.  The links of a list head can also point
+ * back at the head itself, and those of an entry on a list at the same
+ * list_head in another object of the same type.
+ */
+enum snapshot_pointer_kind {
+	SNAP_POINTER,		/* or NULL */
+	SNAP_REQUIRED,		/* never NULL */
+	SNAP_HEAD,
+	SNAP_NODE,
+};
+
+struct snapshot_pointer {
+	unsigned short offset;		/* of the pointer in the object */
+	unsigned char kind;
+	unsigned char type;		/* of what it points to */
+	unsigned short field;		/* and where in that */
+	unsigned short list;		/* the list_head the pointer is in */
+};
+
+#define PTR(structure, member, to)					\
+	{ offsetof(structure, member), SNAP_POINTER, to, 0, 0 }
+#define STRING(structure, member)	PTR(structure, member, SNAP_STRING)
+#define NAME(structure, member)						\
+	{ offsetof(structure, member), SNAP_REQUIRED, SNAP_STRING, 0, 0 }
+#define LINKS(kind, structure, member, to, to_structure, to_member)	\
+	{ offsetof(structure, member.next), kind, to,			\
+	  offsetof(to_structure, to_member), offsetof(structure, member) },	\
+	{ offsetof(structure, member.prev), kind, to,			\
+	  offsetof(to_structure, to_member), offsetof(structure, member) }
+/* the head of a list of @to_member in @to_structure */
+#define HEAD(structure, member, to, to_structure, to_member)		\
+	LINKS(SNAP_HEAD, structure, member, to, to_structure, to_member)
+/* on a list with its head at @to_member in @to_structure */
+#define NODE(structure, member, to, to_structure, to_member)		\
+	LINKS(SNAP_NODE, structure, member, to, to_structure, to_member)
+
+static const struct snapshot_pointer header_pointers[] = {
+	HEAD(struct snapshot_header, devices, SNAP_DEVICE, struct usb_device, list),
+};
+
+static const struct snapshot_pointer device_pointers[] = {
+	NODE(struct usb_device, list, SNAP_HEADER, struct snapshot_header, devices),
+	HEAD(struct usb_device, interfaces, SNAP_INTERFACE, struct usb_interface, list),
+	HEAD(struct usb_device, configs, SNAP_CONFIG, struct usb_config, list),
+	STRING(struct usb_device, manufacturer),
+	STRING(struct usb_device, product),
+	STRING(struct usb_device, serial),
+	NAME(struct usb_device, sysname),
+	PTR(struct usb_device, ep0, SNAP_ENDPOINT),
+	PTR(struct usb_device, qualifier, SNAP_QUALIFIER),
+	STRING(struct usb_device, name),
+	STRING(struct usb_device, driver),
+	PTR(struct usb_device, descriptors, SNAP_DATA),
+};
+
+static const struct snapshot_pointer interface_pointers[] = {
+	NODE(struct usb_interface, list, SNAP_DEVICE, struct usb_device, interfaces),
+	NODE(struct usb_interface, config_list, SNAP_CONFIG, struct usb_config, interfaces),
+	HEAD(struct usb_interface, endpoints, SNAP_ENDPOINT, struct usb_endpoint, list),
+	NAME(struct usb_interface, sysname),
+	STRING(struct usb_interface, name),
+	STRING(struct usb_interface, driver),
+};
+
+static const struct snapshot_pointer config_pointers[] = {
+	NODE(struct usb_config, list, SNAP_DEVICE, struct usb_device, configs),
+	HEAD(struct usb_config, interfaces, SNAP_INTERFACE, struct usb_interface, config_list),
+};
+
+static const struct snapshot_pointer endpoint_pointers[] = {
+	NODE(struct usb_endpoint, list, SNAP_INTERFACE, struct usb_interface, endpoints),
+};
+
+static const struct {
+	const struct snapshot_pointer *pointers;
+	unsigned int count;
+	size_t size;			/* 0 if it can be any size */
+} snapshot_types[] = {
+	[SNAP_HEADER]		= { header_pointers, ARRAY_SIZE(header_pointers),
+				    sizeof(struct snapshot_header) },
+	[SNAP_STRING]		= { NULL, 0, 0 },
+	[SNAP_DEVICE]		= { device_pointers, ARRAY_SIZE(device_pointers),
+				    sizeof(struct usb_device) },
+	[SNAP_INTERFACE]	= { interface_pointers, ARRAY_SIZE(interface_pointers),
+				    sizeof(struct usb_interface) },
+	[SNAP_CONFIG]		= { config_pointers, ARRAY_SIZE(config_pointers),
+				    sizeof(struct usb_config) },
+	[SNAP_ENDPOINT]		= { endpoint_pointers, ARRAY_SIZE(endpoint_pointers),
+				    sizeof(struct usb_endpoint) },
+	[SNAP_QUALIFIER]	= { NULL, 0, sizeof(struct usb_device_qualifier) },
+	[SNAP_DATA]		= { NULL, 0, 0 },
+};
+
+/*
+ * Saving.  First every object that can be reached from the device list is
+ * collected, then sorted by address so any pointer, even one into the middle
+ * of an object (a list_head), can be looked up.
+ */
+struct snapshot_object {
+	const unsigned char *address;
+	size_t size;
+	u64 offset;
+	enum snapshot_type type;
+};
+
+struct snapshot {
+	struct snapshot_object *objects;
+	unsigned int count;
+	unsigned int size;
+	struct list_head *head;		/* the device list */
+	unsigned char *image;
+};
+
+static void add_object(struct snapshot *snapshot, const void *address,
+		       size_t size, enum snapshot_type type)
+{
+	struct snapshot_object *object;
+
+	if (address == NULL)
+		return;
+	if (snapshot->count == snapshot->size) {
+		snapshot->size = snapshot->size ? snapshot->size * 2 : 256;
+		snapshot->objects = realloc(snapshot->objects,
+					    snapshot->size * sizeof(*object));
+		if (snapshot->objects == NULL)
+			exit(1);
+	}
+	object = &snapshot->objects[snapshot->count++];
+	object->address = address;
+	object->size = size;
+	object->type = type;
+}
+
+static void add_string(struct snapshot *snapshot, const char *string)
+{
+	if (string)
+		add_object(snapshot, string, strlen(string) + 1, SNAP_STRING);
+}
+
+static void add_interface(struct snapshot *snapshot, struct usb_interface *usb_intf)
+{
+	struct usb_endpoint *ep;
+
+	add_object(snapshot, usb_intf, sizeof(*usb_intf), SNAP_INTERFACE);
+	add_string(snapshot, usb_intf->sysname);
+	add_string(snapshot, usb_intf->name);
+	add_string(snapshot, usb_intf->driver);
+	list_for_each_entry(ep, &usb_intf->endpoints, list)
+		add_object(snapshot, ep, sizeof(*ep), SNAP_ENDPOINT);
+}
+
+static void add_device(struct snapshot *snapshot, struct usb_device *usb_device)
+{
+	struct usb_interface *usb_intf;
+	struct usb_config *config;
+
+	add_object(snapshot, usb_device, sizeof(*usb_device), SNAP_DEVICE);
+	add_string(snapshot, usb_device->manufacturer);
+	add_string(snapshot, usb_device->product);
+	add_string(snapshot, usb_device->serial);
+	add_string(snapshot, usb_device->sysname);
+	add_string(snapshot, usb_device->name);
+	add_string(snapshot, usb_device->driver);
+	add_object(snapshot, usb_device->ep0, sizeof(*usb_device->ep0), SNAP_ENDPOINT);
+	add_object(snapshot, usb_device->qualifier, sizeof(*usb_device->qualifier),
+		   SNAP_QUALIFIER);
+	add_object(snapshot, usb_device->descriptors, usb_device->descriptors_size,
+		   SNAP_DATA);
+	list_for_each_entry(usb_intf, &usb_device->interfaces, list)
+		add_interface(snapshot, usb_intf);
+	list_for_each_entry(config, &usb_device->configs, list) {
+		add_object(snapshot, config, sizeof(*config), SNAP_CONFIG);
+		/* in descriptor mode these are the same ones as above */
+		list_for_each_entry(usb_intf, &config->interfaces, config_list)
+			add_interface(snapshot, usb_intf);
+	}
+}
+
+static int compare_objects(const void *a, const void *b)
+{
+	const struct snapshot_object *x = a;
+	const struct snapshot_object *y = b;
+
+	if (x->address != y->address)
+		return x->address < y->address ? -1 : 1;
+	return 0;
+}
+
+/* Where @pointer ends up in the file */
+static u64 snapshot_offset(struct snapshot *snapshot, const void *pointer)
+{
+	const unsigned char *address = pointer;
+	unsigned int low = 0;
+	unsigned int high = snapshot->count;
+	struct snapshot_object *object;
+
+	if (pointer == snapshot->head)
+		return offsetof(struct snapshot_header, devices);
+	while (low < high) {
+		unsigned int middle = (low + high) / 2;
+
+		object = &snapshot->objects[middle];
+		if (address < object->address)
+			high = middle;
+		else if (address >= object->address + object->size)
+			low = middle + 1;
+		else
+			return object->offset + (address - object->address);
+	}
+	fprintf(stderr, "snapshot: pointer %p to something we did not save\n", pointer);
+	exit(1);
+}
+
+/* Turn the pointer at @offset in the image into an offset */
+static void relocate_pointer(struct snapshot *snapshot, u64 offset)
+{
+	void **field = (void **)(snapshot->image + offset);
+
+	if (*field == NULL)
+		return;
+	*field = (void *)(uintptr_t)snapshot_offset(snapshot, *field);
+}
+
+static int write_all(int fd, const void *buffer, size_t size)
+{
+	const unsigned char *data = buffer;
+	ssize_t retval;
+
+	while (size) {
+		retval = write(fd, data, size);
+		if (retval < 0 && errno == EINTR)
+			continue;
+		if (retval <= 0)
+			return -1;
+		data += retval;
+		size -= retval;
+	}
+	return 0;
+}
+
+int save_usb_snapshot(const char *filename)
+{
+	struct snapshot_header *header;
+	struct snapshot snapshot;
+	struct snapshot_object *object;
+	struct snapshot_entry *entries;
+	struct usb_device *usb_device;
+	struct usb_interface *usb_intf;
+	unsigned int ndevices = 0;
+	unsigned int i, j, count;
+	u64 size;
+	int retval;
+	int fd;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.head = &usb_devices.devices;
+	list_for_each_entry(usb_device, snapshot.head, list) {
+		/* whoever loads it can't go back to sysfs for the rest */
+		load_usb_device_all(usb_device);
+		add_device(&snapshot, usb_device);
+		ndevices++;
+	}
+
+	/* lay everything out after the header, each object only once */
+	qsort(snapshot.objects, snapshot.count, sizeof(*object), compare_objects);
+	size = sizeof(*header);
+	for (i = 0, count = 0; i < snapshot.count; i++) {
+		object = &snapshot.objects[i];
+		if (count && object->address == snapshot.objects[count - 1].address)
+			continue;
+		if (object->type != SNAP_STRING)
+			size = (size + 7) & ~7ULL;
+		object->offset = size;
+		size += object->size;
+		snapshot.objects[count++] = *object;
+	}
+	snapshot.count = count;
+	size = (size + 7) & ~7ULL;
+
+	snapshot.image = calloc(1, size);
+	entries = calloc(snapshot.count + 1, sizeof(*entries));
+	if (snapshot.image == NULL || entries == NULL)
+		exit(1);
+
+	header = (struct snapshot_header *)snapshot.image;
+	memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+	header->version		= SNAPSHOT_VERSION;
+	header->byte_order	= SNAPSHOT_BYTE_ORDER;
+	header->header_size	= sizeof(*header);
+	header->pointer_size	= sizeof(void *);
+	header->device_size	= sizeof(struct usb_device);
+	header->interface_size	= sizeof(struct usb_interface);
+	header->config_size	= sizeof(struct usb_config);
+	header->endpoint_size	= sizeof(struct usb_endpoint);
+	header->qualifier_size	= sizeof(struct usb_device_qualifier);
+	header->ndevices	= ndevices;
+	header->devices		= *snapshot.head;
+	relocate_pointer(&snapshot, offsetof(struct snapshot_header, devices.next));
+	relocate_pointer(&snapshot, offsetof(struct snapshot_header, devices.prev));
+	entries[0].offset	= 0;
+	entries[0].size		= sizeof(*header);
+	entries[0].type		= SNAP_HEADER;
+
+	for (i = 0; i < snapshot.count; i++) {
+		object = &snapshot.objects[i];
+		memcpy(snapshot.image + object->offset, object->address, object->size);
+		entries[i + 1].offset	= object->offset;
+		entries[i + 1].size	= object->size;
+		entries[i + 1].type	= object->type;
+	}
+	for (i = 0; i < snapshot.count; i++) {
+		object = &snapshot.objects[i];
+		if (object->type == SNAP_DEVICE) {
+			/* only mean something in this process */
+			usb_device = (struct usb_device *)(snapshot.image + object->offset);
+			usb_device->hash_next = NULL;
+			usb_device->arena = NULL;
+			usb_device->parent = NULL;
+			memset(&usb_device->children, 0, sizeof(usb_device->children));
+			memset(&usb_device->sibling, 0, sizeof(usb_device->sibling));
+		} else if (object->type == SNAP_INTERFACE) {
+			usb_intf = (struct usb_interface *)(snapshot.image + object->offset);
+			usb_intf->arena = NULL;
+		}
+		for (j = 0; j < snapshot_types[object->type].count; j++)
+			relocate_pointer(&snapshot, object->offset +
+					 snapshot_types[object->type].pointers[j].offset);
+	}
+	header->size = size + (snapshot.count + 1) * sizeof(*entries);
+	header->objects = size;
+	header->nobjects = snapshot.count + 1;
+
+	retval = -1;
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd != -1) {
+		if (write_all(fd, snapshot.image, size) == 0 &&
+		    write_all(fd, entries, header->nobjects * sizeof(*entries)) == 0)
+			retval = 0;
+		if (close(fd))
+			retval = -1;
+	}
+	free(snapshot.image);
+	free(entries);
+	free(snapshot.objects);
+	return retval;
+}
+
+static int check_header(const struct snapshot_header *header, size_t size)
+{
+	if (size < sizeof(*header) ||
+	    memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+		return -1;
+	if (header->version != SNAPSHOT_VERSION ||
+	    header->byte_order != SNAPSHOT_BYTE_ORDER ||
+	    header->header_size != sizeof(*header) ||
+	    header->pointer_size != sizeof(void *) ||
+	    header->device_size != sizeof(struct usb_device) ||
+	    header->interface_size != sizeof(struct usb_interface) ||
+	    header->config_size != sizeof(struct usb_config) ||
+	    header->endpoint_size != sizeof(struct usb_endpoint) ||
+	    header->qualifier_size != sizeof(struct usb_device_qualifier))
+		return -1;
+	if (header->size != size || header->objects > size ||
+	    header->objects < sizeof(*header) ||
+	    header->objects % sizeof(u64) ||
+	    header->nobjects != (size - header->objects) / sizeof(struct snapshot_entry) ||
+	    (size - header->objects) % sizeof(struct snapshot_entry))
+		return -1;
+	return 0;
+}
+
+/*
+ * Every object has to be in the image, after the one before it, and be the
+ * size its type says it is.  Strings have to end in a NUL.
+ */
+static int check_objects(const unsigned char *image,
+			 const struct snapshot_header *header,
+			 const struct snapshot_entry *entries)
+{
+	const struct snapshot_entry *entry;
+	u64 end = 0;
+	u64 i;
+
+	if (header->nobjects == 0 || entries[0].type != SNAP_HEADER ||
+	    entries[0].offset != 0)
+		return -1;
+	for (i = 0; i < header->nobjects; i++) {
+		entry = &entries[i];
+		if (entry->type >= NR_SNAP_TYPES ||
+		    (entry->type == SNAP_HEADER && i != 0) ||
+		    entry->offset < end || entry->offset > header->objects ||
+		    entry->size == 0 ||
+		    entry->size > header->objects - entry->offset)
+			return -1;
+		if (snapshot_types[entry->type].size &&
+		    (entry->size != snapshot_types[entry->type].size ||
+		     entry->offset % sizeof(u64)))
+			return -1;
+		if (entry->type == SNAP_STRING &&
+		    image[entry->offset + entry->size - 1] != '\0')
+			return -1;
+		end = entry->offset + entry->size;
+	}
+	return 0;
+}
+
+/* The object @offset is in, if any */
+static const struct snapshot_entry *find_entry(const struct snapshot_header *header,
+					       const struct snapshot_entry *entries,
+					       u64 offset)
+{
+	u64 low = 0;
+	u64 high = header->nobjects;
+
+	while (low < high) {
+		u64 middle = low + (high - low) / 2;
+
+		if (offset < entries[middle].offset)
+			high = middle;
+		else if (offset - entries[middle].offset >= entries[middle].size)
+			low = middle + 1;
+		else
+			return &entries[middle];
+	}
+	return NULL;
+}
+
+/* Is @target something @pointer in @owner may point at? */
+static int check_pointer(const struct snapshot_header *header,
+			 const struct snapshot_entry *entries,
+			 const struct snapshot_entry *owner,
+			 const struct snapshot_pointer *pointer, u64 target)
+{
+	const struct snapshot_entry *entry;
+	u64 field;
+
+	if (target == 0)
+		return pointer->kind == SNAP_POINTER || pointer->kind == SNAP_NODE ? 0 : -1;
+	entry = find_entry(header, entries, target);
+	if (entry == NULL)
+		return -1;
+	field = target - entry->offset;
+	if (pointer->kind == SNAP_HEAD && entry == owner && field == pointer->list)
+		return 0;
+	if (pointer->kind == SNAP_NODE && entry->type == owner->type &&
+	    field == pointer->list)
+		return 0;
+	if (entry->type != pointer->type || field != pointer->field)
+		return -1;
+	return 0;
+}
+
+/*
+ * The links of every list have to agree with each other, which also means
+ * that following them from a head goes all the way around and back to it.
+ * On the way there must be nothing but what the list is of, not the head of
+ * some other list.
+ */
+static int check_list(unsigned char *image, const struct snapshot_header *header,
+		      const struct snapshot_entry *entries,
+		      const struct snapshot_entry *owner,
+		      const struct snapshot_pointer *pointer)
+{
+	struct list_head *head = (struct list_head *)(image + owner->offset +
+						      pointer->list);
+	const struct snapshot_entry *entry;
+	struct list_head *pos;
+
+	if (head->next == NULL || head->prev == NULL)
+		return pointer->kind == SNAP_NODE && head->next == head->prev ? 0 : -1;
+	if (head->next->prev != head || head->prev->next != head)
+		return -1;
+	if (pointer->kind != SNAP_HEAD)
+		return 0;
+	for (pos = head->next; pos != head; pos = pos->next) {
+		entry = find_entry(header, entries, (unsigned char *)pos - image);
+		if (entry == NULL || entry->type != pointer->type ||
+		    (unsigned char *)pos - image - entry->offset != pointer->field)
+			return -1;
+		if (pos->next == NULL || pos->next->prev != pos)
+			return -1;
+	}
+	return 0;
+}
+
+/* What load_usb_device() and friends rely on, beyond the pointers */
+static int check_device(unsigned char *image, const struct snapshot_header *header,
+			const struct snapshot_entry *entries,
+			struct usb_device *usb_device)
+{
+	const struct snapshot_entry *entry;
+
+	if (usb_device->descriptors) {
+		entry = find_entry(header, entries, usb_device->descriptors - image);
+		if (usb_device->descriptors_size > entry->size)
+			return -1;
+	} else if (usb_device->descriptors_size) {
+		return -1;
+	}
+	usb_device->hash_next = NULL;
+	usb_device->arena = NULL;
+	usb_device->parent = NULL;
+	INIT_LIST_HEAD(&usb_device->children);
+	INIT_LIST_HEAD(&usb_device->sibling);
+	return 0;
+}
+
+/*
+ * Loading.  The file is mapped privately, so fixing up the pointers only
+ * touches our own copy of the pages, and nothing is parsed or allocated.
+ * The mapping stays around until we exit.
+ */
+int load_usb_snapshot(const char *filename)
+{
+	const struct snapshot_pointer *pointer;
+	const struct snapshot_entry *entries;
+	const struct snapshot_entry *entry;
+	struct snapshot_header *header;
+	struct usb_device *usb_device;
+	struct usb_device *temp;
+	unsigned char *image;
+	struct stat st;
+	uintptr_t *field;
+	unsigned int j;
+	u64 i;
+	int fd;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*header)) {
+		close(fd);
+		return -1;
+	}
+	image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+		return -1;
+
+	header = (struct snapshot_header *)image;
+	if (check_header(header, st.st_size))
+		goto error;
+	entries = (const struct snapshot_entry *)(image + header->objects);
+	if (check_objects(image, header, entries))
+		goto error;
+
+	/* every pointer is checked before any of them gets followed */
+	for (i = 0; i < header->nobjects; i++) {
+		entry = &entries[i];
+		for (j = 0; j < snapshot_types[entry->type].count; j++) {
+			pointer = &snapshot_types[entry->type].pointers[j];
+			field = (uintptr_t *)(image + entry->offset + pointer->offset);
+			if (check_pointer(header, entries, entry, pointer, *field))
+				goto error;
+			if (*field)
+				*field += (uintptr_t)image;
+		}
+	}
+	for (i = 0; i < header->nobjects; i++) {
+		entry = &entries[i];
+		for (j = 0; j < snapshot_types[entry->type].count; j++) {
+			pointer = &snapshot_types[entry->type].pointers[j];
+			/* once for each list_head, not for both of its links */
+			if ((pointer->kind == SNAP_HEAD || pointer->kind == SNAP_NODE) &&
+			    pointer->offset == pointer->list &&
+			    check_list(image, header, entries, entry, pointer))
+				goto error;
+		}
+		if (entry->type == SNAP_DEVICE &&
+		    check_device(image, header, entries,
+				 (struct usb_device *)(image + entry->offset)))
+			goto error;
+		if (entry->type == SNAP_INTERFACE)
+			((struct usb_interface *)(image + entry->offset))->arena = NULL;
+	}
+
+	list_for_each_entry_safe(usb_device, temp, &header->devices, list)
+		add_usb_device(&usb_devices, usb_device);
+	return 0;
+
+error:
+	munmap(image, st.st_size);
+	errno = EINVAL;
+	return -1;
+}
@@ -0,0 +1,213 @@
+/*
+ * stats.c
+ *
+ * --stats: where the time of a run went, and how much work it took.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "arena.h"
+
+
+
+/*
+ * The run is split into phases, one after the other, and each gets the wall
+ * and CPU time it took and how much the counters moved while it ran.  CPU
+ * time is for the whole process, so with -j it adds up all of the workers.
+ *
+ * The parts of building a device overlap with each other (the attributes of
+ * the device are read in the same batch as those of its interfaces), and with
+ * -j they run on several threads at once, so those are not phases but timers
+ * that add up the time spent in each, over all threads.
+ *
+ * Only what lsusb does itself is counted: with the libudev backend, the
+ * opens and reads libudev does behind our back don't show up.
+ */
+int stats_enabled;
+unsigned long stat_counters[NR_STAT_COUNTERS];
+
+static const char * const phase_names[NR_PHASES] = {
+	[PHASE_ENUMERATE]	= "enumerate",
+	[PHASE_BUILD]		= "build",
+	[PHASE_SORT]		= "sort",
+	[PHASE_PRINT]		= "print",
+	[PHASE_TEARDOWN]	= "teardown",
+};
+
+static const char * const counter_names[NR_STAT_COUNTERS] = {
+	[STAT_DEVICES]		= "devices",
+	[STAT_OPENS]		= "opens",
+	[STAT_READS]		= "reads",
+	[STAT_READ_BYTES]	= "read_bytes",
+	[STAT_ALLOCS]		= "allocs",
+	[STAT_ALLOC_BYTES]	= "alloc_bytes",
+};
+
+static const char * const timer_names[NR_STAT_TIMERS] = {
+	[TIMER_DESCRIPTORS]	= "descriptors",
+	[TIMER_DIRECTORIES]	= "directories",
+	[TIMER_ATTRIBUTES]	= "attributes",
+};
+
+struct phase_stats {
+	double wall;		/* ms */
+	double cpu;		/* ms */
+	unsigned long counters[NR_STAT_COUNTERS];
+};
+
+static struct phase_stats phases[NR_PHASES];
+static unsigned long stat_timers[NR_STAT_TIMERS];	/* ns */
+
+static struct timespec wall_start;
+static struct timespec cpu_start;
+static unsigned long counters_start[NR_STAT_COUNTERS];
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1e3 +
+	       (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+void phase_begin(void)
+{
+	if (!stats_enabled)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	memcpy(counters_start, stat_counters, sizeof(counters_start));
+}
+
+/* Charge everything since the last phase_begin() or phase_end() to @phase */
+void phase_end(enum stat_phase phase)
+{
+	struct phase_stats *stats = &phases[phase];
+	struct timespec wall;
+	struct timespec cpu;
+	int i;
+
+	if (!stats_enabled)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+	stats->wall += elapsed_ms(&wall_start, &wall);
+	stats->cpu += elapsed_ms(&cpu_start, &cpu);
+	for (i = 0; i < NR_STAT_COUNTERS; i++)
+		stats->counters[i] += stat_counters[i] - counters_start[i];
+	wall_start = wall;
+	cpu_start = cpu;
+	memcpy(counters_start, stat_counters, sizeof(counters_start));
+}
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* returns what to hand to stat_timer_end(), nothing is timed without --stats */
+unsigned long stat_timer_begin(void)
+{
+	return stats_enabled ? now_ns() : 0;
+}
+
+void stat_timer_end(enum stat_timer timer, unsigned long start)
+{
+	if (stats_enabled)
+		__atomic_fetch_add(&stat_timers[timer], now_ns() - start,
+				   __ATOMIC_RELAXED);
+}
+
+static void add_phase(struct phase_stats *total, const struct phase_stats *stats)
+{
+	int i;
+
+	total->wall += stats->wall;
+	total->cpu += stats->cpu;
+	for (i = 0; i < NR_STAT_COUNTERS; i++)
+		total->counters[i] += stats->counters[i];
+}
+
+static void print_phase_text(FILE *file, const char *name,
+			     const struct phase_stats *stats)
+{
+	int i;
+
+	fprintf(file, "stats: %-10s %10.3f %10.3f", name, stats->wall, stats->cpu);
+	for (i = 0; i < NR_STAT_COUNTERS; i++)
+		fprintf(file, " %11lu", stats->counters[i]);
+	fprintf(file, "\n");
+}
+
+static void print_phase_json(FILE *file, const char *name,
+			     const struct phase_stats *stats)
+{
+	int i;
+
+	fprintf(file, "\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f",
+		name, stats->wall, stats->cpu);
+	for (i = 0; i < NR_STAT_COUNTERS; i++)
+		fprintf(file, ",\"%s\":%lu", counter_names[i], stats->counters[i]);
+	fprintf(file, "}");
+}
+
+/*
+ * One table, or with @json one JSON object on a line of its own, so it can
+ * be picked out of stderr and handed straight to whatever collects metrics.
+ */
+void print_stats(FILE *file, int json)
+{
+	struct phase_stats total;
+	int i;
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < NR_PHASES; i++)
+		add_phase(&total, &phases[i]);
+
+	if (json) {
+		fprintf(file, "{\"phases\":{");
+		for (i = 0; i < NR_PHASES; i++) {
+			if (i)
+				fprintf(file, ",");
+			print_phase_json(file, phase_names[i], &phases[i]);
+		}
+		fprintf(file, "},");
+		print_phase_json(file, "total", &total);
+		fprintf(file, ",\"build_ms\":{");
+		for (i = 0; i < NR_STAT_TIMERS; i++)
+			fprintf(file, "%s\"%s\":%.3f", i ? "," : "",
+				timer_names[i], stat_timers[i] / 1e6);
+		fprintf(file, "},\"arena_high_water\":%zu}\n", scan_arena.high_water);
+		return;
+	}
+
+	fprintf(file, "stats: %-10s %10s %10s", "phase", "wall ms", "cpu ms");
+	for (i = 0; i < NR_STAT_COUNTERS; i++)
+		fprintf(file, " %11s", counter_names[i]);
+	fprintf(file, "\n");
+	for (i = 0; i < NR_PHASES; i++)
+		print_phase_text(file, phase_names[i], &phases[i]);
+	print_phase_text(file, "total", &total);
+	fprintf(file, "stats: build time in");
+	for (i = 0; i < NR_STAT_TIMERS; i++)
+		fprintf(file, "%s %s %.3f ms", i ? "," : "",
+			timer_names[i], stat_timers[i] / 1e6);
+	fprintf(file, ", arena high water %zu bytes\n", scan_arena.high_water);
+}
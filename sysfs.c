@@ -0,0 +1,508 @@
+/*
+ * sysfs.c
+ *
+ * Get at the USB devices in sysfs, either through libudev or by walking the
+ * sysfs directories ourselves.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LIBUDEV
+#define LIBUDEV_I_KNOW_THE_API_IS_SUBJECT_TO_CHANGE
+#include <libudev.h>
+#endif
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+
+#ifndef SYSFS_ROOT
+#define SYSFS_ROOT	"/sys"
+#endif
+
+const char *sysfs_root = SYSFS_ROOT;
+
+#ifdef HAVE_LIBUDEV
+int use_libudev = 1;
+
+/* libudev contexts can not be shared between threads, so each gets one */
+static __thread struct udev *udev;
+#else
+int use_libudev = 0;
+#endif
+
+/*
+ * The libudev backend is the reference, it caches everything it reads about
+ * a device.  The sysfs backend keeps an open directory for each device and
+ * reads attributes relative to that, which is all we really need.
+ */
+void sysfs_thread_init(void)
+{
+#ifdef HAVE_LIBUDEV
+	if (use_libudev)
+		udev = udev_new();
+#endif
+	attr_thread_init();
+}
+
+void sysfs_thread_exit(void)
+{
+	attr_thread_exit();
+#ifdef HAVE_LIBUDEV
+	if (use_libudev)
+		udev_unref(udev);
+#endif
+}
+
+const char *read_dev_attr(struct sysfs_dev *dev, const char *name,
+			  char *value, size_t size)
+{
+	ssize_t len;
+	int file;
+
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device)
+		return udev_device_get_sysattr_value(dev->udev_device, name);
+#endif
+	count_stat(STAT_OPENS, 1);
+	file = openat(dev->dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (file == -1)
+		return NULL;
+	count_stat(STAT_READS, 1);
+	len = read(file, value, size - 1);
+	close(file);
+	if (len < 0)
+		return NULL;
+	count_stat(STAT_READ_BYTES, len);
+	/* sysfs ends everything with a newline, libudev strips it, so do we */
+	while (len > 0 && value[len - 1] == '\n')
+		len--;
+	value[len] = '\0';
+	return value;
+}
+
+int open_dev_file(struct sysfs_dev *dev, const char *name)
+{
+#ifdef HAVE_LIBUDEV
+	char filename[PATH_MAX];
+#endif
+
+	count_stat(STAT_OPENS, 1);
+#ifdef HAVE_LIBUDEV
+
+	if (dev->udev_device) {
+		snprintf(filename, sizeof(filename), "%s/%s",
+			 udev_device_get_syspath(dev->udev_device), name);
+		return open(filename, O_RDONLY | O_CLOEXEC);
+	}
+#endif
+	return openat(dev->dirfd, name, O_RDONLY | O_CLOEXEC);
+}
+
+/*
+ * Call @fn for every entry in the directory of @dev, in one pass.  The sysfs
+ * backend reads the entries straight out of the device's directory fd with
+ * getdents64(), so there is no extra open or stat like opendir() does.  That
+ * means it can only be done once for each sysfs_dev, which is all we need.
+ */
+struct linux_dirent64 {
+	u64		d_ino;
+	s64		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+
+int read_dev_dir(struct sysfs_dev *dev,
+		 void (*fn)(const char *name, unsigned char type, void *data),
+		 void *data)
+{
+	char buffer[8192] __attribute__((aligned(8)));
+	struct linux_dirent64 *dirent;
+	long len;
+	long pos;
+
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device) {
+		struct dirent *entry;
+		DIR *dir;
+
+		count_stat(STAT_OPENS, 1);
+		dir = opendir(udev_device_get_syspath(dev->udev_device));
+		if (dir == NULL)
+			return -1;
+		while ((entry = readdir(dir)) != NULL)
+			fn(entry->d_name, entry->d_type, data);
+		count_stat(STAT_READS, 1);
+		closedir(dir);
+		return 0;
+	}
+#endif
+	while ((len = syscall(SYS_getdents64, dev->dirfd, buffer, sizeof(buffer))) > 0) {
+		count_stat(STAT_READS, 1);
+		count_stat(STAT_READ_BYTES, len);
+		for (pos = 0; pos < len; pos += dirent->d_reclen) {
+			dirent = (struct linux_dirent64 *)&buffer[pos];
+			fn(dirent->d_name, dirent->d_type, data);
+		}
+	}
+	return len == 0 ? 0 : -1;
+}
+
+const char *get_dev_sysname(struct sysfs_dev *dev)
+{
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device)
+		return udev_device_get_sysname(dev->udev_device);
+#endif
+	return dev->sysname;
+}
+
+/* The driver name is the last part of where a "driver" link points to */
+static const char *read_driver_link(int dirfd, const char *path,
+				    char *driver, size_t size)
+{
+	char link[PATH_MAX];
+	const char *name;
+	ssize_t len;
+
+	count_stat(STAT_READS, 1);
+	len = readlinkat(dirfd, path, link, sizeof(link) - 1);
+	if (len <= 0)
+		return NULL;
+	count_stat(STAT_READ_BYTES, len);
+	link[len] = '\0';
+	name = strrchr(link, '/');
+	name = name ? name + 1 : link;
+	snprintf(driver, size, "%s", name);
+	return driver;
+}
+
+const char *get_dev_driver(struct sysfs_dev *dev, char *driver, size_t size)
+{
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device)
+		return udev_device_get_driver(dev->udev_device);
+#endif
+	return read_driver_link(dev->dirfd, "driver", driver, size);
+}
+
+/* Driver bound to a child (interface) of @dev, without opening the child */
+const char *get_dev_child_driver(struct sysfs_dev *dev, const char *child,
+				 char *driver, size_t size)
+{
+	char path[PATH_MAX];
+
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device) {
+		snprintf(path, sizeof(path), "%s/%s/driver",
+			 udev_device_get_syspath(dev->udev_device), child);
+		return read_driver_link(AT_FDCWD, path, driver, size);
+	}
+#endif
+	snprintf(path, sizeof(path), "%s/driver", child);
+	return read_driver_link(dev->dirfd, path, driver, size);
+}
+
+static int set_dev_sysname(struct sysfs_dev *dev, const char *name)
+{
+	if (strlen(name) >= sizeof(dev->sysname))
+		return -1;
+	strcpy(dev->sysname, name);
+	return 0;
+}
+
+/* Open a child directory of a device, an interface for example */
+int open_child_dev(struct sysfs_dev *dev, const char *name, struct sysfs_dev *child)
+{
+	memset(child, 0, sizeof(*child));
+	child->dirfd = -1;
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device) {
+		char syspath[PATH_MAX];
+
+		snprintf(syspath, sizeof(syspath), "%s/%s",
+			 udev_device_get_syspath(dev->udev_device), name);
+		child->udev_device = udev_device_new_from_syspath(udev, syspath);
+		return child->udev_device ? 0 : -1;
+	}
+#endif
+	if (set_dev_sysname(child, name))
+		return -1;
+	count_stat(STAT_OPENS, 1);
+	child->dirfd = openat(dev->dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return child->dirfd == -1 ? -1 : 0;
+}
+
+/*
+ * Open a device or interface again by its name, long after the scan.  Both
+ * live in bus/usb/devices, so the name is all it takes.
+ */
+int open_usb_dev(const char *sysname, struct sysfs_dev *dev)
+{
+	char path[PATH_MAX];
+
+	memset(dev, 0, sizeof(*dev));
+	dev->dirfd = -1;
+#ifdef HAVE_LIBUDEV
+	if (use_libudev) {
+		dev->udev_device = udev_device_new_from_subsystem_sysname(udev,
+								"usb", sysname);
+		return dev->udev_device ? 0 : -1;
+	}
+#endif
+	if (set_dev_sysname(dev, sysname))
+		return -1;
+	snprintf(path, sizeof(path), "%s/bus/usb/devices/%s", sysfs_root, sysname);
+	count_stat(STAT_OPENS, 1);
+	dev->dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return dev->dirfd == -1 ? -1 : 0;
+}
+
+void close_dev(struct sysfs_dev *dev)
+{
+#ifdef HAVE_LIBUDEV
+	if (dev->udev_device)
+		udev_device_unref(dev->udev_device);
+	dev->udev_device = NULL;
+#endif
+	if (dev->dirfd != -1)
+		close(dev->dirfd);
+	dev->dirfd = -1;
+}
+
+/*
+ * Enumeration.  sysfs_scan_begin() finds everything on the usb bus, and then
+ * sysfs_scan_open() can be called for each entry, from any thread, to get at
+ * the USB devices (interfaces are skipped, they are found from their device).
+ */
+#ifdef HAVE_LIBUDEV
+static int udev_scan_begin(struct sysfs_scan *scan)
+{
+	struct udev_list_entry *list_entry;
+	unsigned int i = 0;
+
+	/* prepare a device scan */
+	scan->enumerate = udev_enumerate_new(udev);
+	/* filter for usb devices */
+	udev_enumerate_add_match_subsystem(scan->enumerate, "usb");
+	/* retrieve the list */
+	udev_enumerate_scan_devices(scan->enumerate);
+
+	udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(scan->enumerate))
+		scan->count++;
+	scan->names = calloc(scan->count ? scan->count : 1, sizeof(*scan->names));
+	if (scan->names == NULL)
+		exit(1);
+	udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(scan->enumerate))
+		scan->names[i++] = (char *)udev_list_entry_get_name(list_entry);
+	return 0;
+}
+#endif
+
+static int is_usb_device_name(const char *name)
+{
+	/*
+	 * root hubs are "usbN", everything else "bus-port[.port...]", and
+	 * interfaces have a ":config.interface" on the end.
+	 */
+	if (strchr(name, ':') != NULL)
+		return 0;
+	if (strncmp(name, "usb", 3) == 0)
+		return isdigit(name[3]);
+	return isdigit(name[0]);
+}
+
+int sysfs_scan_begin(struct sysfs_scan *scan)
+{
+	char path[PATH_MAX];
+	struct dirent *dirent;
+	unsigned int size = 0;
+	DIR *dir;
+
+	memset(scan, 0, sizeof(*scan));
+	scan->busfd = -1;
+#ifdef HAVE_LIBUDEV
+	if (use_libudev)
+		return udev_scan_begin(scan);
+#endif
+	snprintf(path, sizeof(path), "%s/bus/usb/devices", sysfs_root);
+	count_stat(STAT_OPENS, 2);
+	dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+	scan->busfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	count_stat(STAT_READS, 1);
+	while ((dirent = readdir(dir)) != NULL) {
+		if (!is_usb_device_name(dirent->d_name))
+			continue;
+		if (scan->count == size) {
+			size = size ? size * 2 : 64;
+			scan->names = realloc(scan->names, size * sizeof(*scan->names));
+			if (scan->names == NULL)
+				exit(1);
+		}
+		scan->names[scan->count] = strdup(dirent->d_name);
+		if (scan->names[scan->count] == NULL)
+			exit(1);
+		scan->count++;
+	}
+	closedir(dir);
+	return 0;
+}
+
+/* returns 0 and fills in @dev if entry @i is a USB device */
+int sysfs_scan_open(struct sysfs_scan *scan, unsigned int i, struct sysfs_dev *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->dirfd = -1;
+#ifdef HAVE_LIBUDEV
+	if (use_libudev) {
+		const char *devtype;
+
+		dev->udev_device = udev_device_new_from_syspath(udev, scan->names[i]);
+		if (dev->udev_device == NULL)
+			return -1;
+		devtype = udev_device_get_devtype(dev->udev_device);
+		if (devtype == NULL || strcmp("usb_device", devtype) != 0) {
+			close_dev(dev);
+			return -1;
+		}
+		return 0;
+	}
+#endif
+	if (set_dev_sysname(dev, scan->names[i]))
+		return -1;
+	count_stat(STAT_OPENS, 1);
+	dev->dirfd = openat(scan->busfd, scan->names[i],
+			    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return dev->dirfd == -1 ? -1 : 0;
+}
+
+void sysfs_scan_end(struct sysfs_scan *scan)
+{
+	unsigned int i;
+
+#ifdef HAVE_LIBUDEV
+	if (scan->enumerate) {
+		udev_enumerate_unref(scan->enumerate);
+		free(scan->names);
+		return;
+	}
+#endif
+	for (i = 0; i < scan->count; i++)
+		free(scan->names[i]);
+	free(scan->names);
+	if (scan->busfd != -1)
+		close(scan->busfd);
+}
+
+/*
+ * Hotplug.  The monitor hands out the usb devices and interfaces that come
+ * and go as a sysfs_dev, the same as a scan does, along with what happened
+ * to them.  It has a udev context of its own so it works with either backend.
+ *
+ * The kernel drops uevents when the socket is full, so it gets a buffer big
+ * enough for anything short of a hub full of hubs being plugged in at once
+ * (unprivileged, the kernel caps it at rmem_max).  When that is not enough,
+ * sysfs_monitor_receive() fails with errno ENOBUFS, and the caller has to
+ * go and find out what it missed.
+ */
+#define MONITOR_BUFFER_SIZE	(16 * 1024 * 1024)
+
+#ifdef HAVE_LIBUDEV
+static struct udev *monitor_udev;
+static struct udev_monitor *monitor;
+
+int sysfs_monitor_begin(void)
+{
+	monitor_udev = udev_new();
+	if (monitor_udev == NULL)
+		return -1;
+	monitor = udev_monitor_new_from_netlink(monitor_udev, "udev");
+	if (monitor == NULL)
+		return -1;
+	udev_monitor_filter_add_match_subsystem_devtype(monitor, "usb", NULL);
+	udev_monitor_set_receive_buffer_size(monitor, MONITOR_BUFFER_SIZE);
+	if (udev_monitor_enable_receiving(monitor))
+		return -1;
+	return udev_monitor_get_fd(monitor);
+}
+
+int sysfs_monitor_receive(struct sysfs_dev *dev, struct sysfs_event *event)
+{
+	struct udev_device *udev_device;
+	const char *value;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->dirfd = -1;
+	errno = 0;
+	udev_device = udev_monitor_receive_device(monitor);
+	if (udev_device == NULL)
+		return -1;
+
+	value = udev_device_get_action(udev_device);
+	snprintf(event->action, sizeof(event->action), "%s", value ? value : "");
+	value = udev_device_get_devtype(udev_device);
+	snprintf(event->devtype, sizeof(event->devtype), "%s", value ? value : "");
+
+	if (use_libudev) {
+		dev->udev_device = udev_device;
+		return 0;
+	}
+	/* a removed device has no directory any more, the name is all we get */
+	if (set_dev_sysname(dev, udev_device_get_sysname(udev_device)) == 0)
+		dev->dirfd = open(udev_device_get_syspath(udev_device),
+				  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	udev_device_unref(udev_device);
+	if (dev->sysname[0] == '\0') {
+		errno = ENOENT;
+		return -1;
+	}
+	return 0;
+}
+
+void sysfs_monitor_end(void)
+{
+	if (monitor)
+		udev_monitor_unref(monitor);
+	if (monitor_udev)
+		udev_unref(monitor_udev);
+	monitor = NULL;
+	monitor_udev = NULL;
+}
+#else
+int sysfs_monitor_begin(void)
+{
+	return -1;
+}
+
+int sysfs_monitor_receive(struct sysfs_dev *dev, struct sysfs_event *event)
+{
+	(void)dev;
+	(void)event;
+	return -1;
+}
+
+void sysfs_monitor_end(void)
+{
+}
+#endif
@@ -0,0 +1,183 @@
+/*
+ * uring.c
+ *
+ * Just enough io_uring to push a batch of opens, reads and closes at the
+ * kernel with one system call each, without needing liburing.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+			     unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Make sure the kernel knows all of the opcodes we are going to use */
+static int uring_probe(struct uring *ring)
+{
+	static const int needed[] = {
+		IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE,
+	};
+	struct io_uring_probe *probe;
+	size_t size;
+	unsigned int i;
+	int retval = 0;
+
+	size = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = calloc(1, size);
+	if (probe == NULL)
+		return -1;
+	if (io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		free(probe);
+		return -1;
+	}
+	for (i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+		if (needed[i] > probe->last_op ||
+		    !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+			retval = -1;
+	}
+	free(probe);
+	return retval;
+}
+
+int uring_init(struct uring *ring, unsigned int entries)
+{
+	struct io_uring_params p;
+	unsigned char *sq;
+	unsigned char *cq;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&p, 0, sizeof(p));
+	ring->fd = io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+	    ring->sqes == MAP_FAILED) {
+		uring_exit(ring);
+		return -1;
+	}
+
+	sq = ring->sq_ring;
+	ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ring->sq_mask = *(unsigned int *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+
+	cq = ring->cq_ring;
+	ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ring->cq_mask = *(unsigned int *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	if (uring_probe(ring)) {
+		uring_exit(ring);
+		return -1;
+	}
+	return 0;
+}
+
+void uring_exit(struct uring *ring)
+{
+	if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->cq_ring && ring->cq_ring != MAP_FAILED)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sqes && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->fd > 0)
+		close(ring->fd);
+	memset(ring, 0, sizeof(*ring));
+}
+
+/* Get the next free submission entry, NULL if the ring is full */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int index;
+
+	if (ring->queued == ring->sq_entries)
+		return NULL;
+	index = (*ring->sq_tail + ring->queued) & ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	ring->queued++;
+	return sqe;
+}
+
+/*
+ * Submit everything queued up, wait for all of it to complete and hand the
+ * result of each one to @fn.
+ */
+int uring_submit_and_wait(struct uring *ring,
+			  void (*fn)(u64 user_data, int res, void *data),
+			  void *data)
+{
+	unsigned int submitted = ring->queued;
+	unsigned int head;
+	unsigned int done = 0;
+	int retval;
+
+	if (submitted == 0)
+		return 0;
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + submitted, __ATOMIC_RELEASE);
+	ring->queued = 0;
+
+	do {
+		retval = io_uring_enter(ring->fd, done ? 0 : submitted,
+					submitted - done, IORING_ENTER_GETEVENTS);
+		if (retval < 0 && errno != EINTR)
+			return -1;
+
+		head = *ring->cq_head;
+		while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+			fn(cqe->user_data, cqe->res, data);
+			head++;
+			done++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	} while (done < submitted);
+	return 0;
+}
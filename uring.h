@@ -0,0 +1,37 @@
+#ifndef _URING_H
+#define _URING_H
+
+#include "short_types.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct uring {
+	int fd;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int queued;
+	struct io_uring_sqe *sqes;
+
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	size_t sqes_size;
+};
+
+int uring_init(struct uring *ring, unsigned int entries);
+void uring_exit(struct uring *ring);
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+int uring_submit_and_wait(struct uring *ring,
+			  void (*fn)(u64 user_data, int res, void *data),
+			  void *data);
+
+#endif	/* define _URING_H */
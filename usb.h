@@ -3,19 +3,20 @@
 
 #include "short_types.h"
 
+struct arena;
+
 struct usb_endpoint {
 	struct list_head list;
-	char *bEndpointAddress;
-	char *bInterval;
-	char *bLength;
-	char *bmAttributes;
-	char *direction;
-	char *type;
-	char *wMaxPacketSize;
+	u8 bLength;
+	u8 bEndpointAddress;
+	u8 bmAttributes;
+	u8 bInterval;
+	u16 wMaxPacketSize;
 };
 
 struct usb_config {
 	struct list_head list;
+	struct list_head interfaces;	/* every alternate setting */
 	u8 bLength;
 	u8 bDescriptorType;
 	u16 wTotalLength;
@@ -28,64 +29,80 @@ struct usb_config {
 
 struct usb_interface {
 	struct list_head list;
+	struct list_head config_list;	/* on usb_config->interfaces */
 	struct list_head endpoints;
+	struct arena *arena;		/* hotplugged interfaces have their own */
 	unsigned int configuration;
 	unsigned int ifnum;
 
-	char *sysname;
-	char *bAlternateSetting;
-	char *bInterfaceClass;
-	char *bInterfaceNumber;
-	char *bInterfaceProtocol;
-	char *bInterfaceSubClass;
-	char *bNumEndpoints;
+	u8 bAlternateSetting;
+	u8 bInterfaceClass;
+	u8 bInterfaceNumber;
+	u8 bInterfaceProtocol;
+	u8 bInterfaceSubClass;
+	u8 bNumEndpoints;
+	u32 loaded;			/* see load_usb_interface() */
 
+	char *sysname;
 	char *name;
 	char *driver;
 };
 
 struct usb_device_qualifier {
-	char *bLength;
-	char *bDescriptorType;
-	char *bcdUSB;
-	char *bDeviceClass;
-	char *bDeviceSubClass;
-	char *bDeviceProtocol;
-	char *bMaxPacketSize0;
-	char *bNumConfigurations;
+	u8 bLength;
+	u8 bDescriptorType;
+	u16 bcdUSB;
+	u8 bDeviceClass;
+	u8 bDeviceSubClass;
+	u8 bDeviceProtocol;
+	u8 bMaxPacketSize0;
+	u8 bNumConfigurations;
 };
 
 struct usb_device {
 	struct list_head list;			/* connect devices independant of the bus */
 	struct list_head interfaces;
+	struct list_head configs;		/* from the raw descriptors */
+	u64 sort_key;			/* filled in by sort_usb_devices() */
+	struct usb_device *hash_next;	/* see find_usb_device() */
+	struct arena *arena;		/* hotplugged devices have their own */
+	struct usb_device *parent;	/* see link_usb_devices() */
+	struct list_head children;
+	struct list_head sibling;	/* on parent->children */
+	u8 portnum;			/* on the parent hub */
+
+	u16 busnum;
+	u16 devnum;
+	u16 idVendor;
+	u16 idProduct;
+	u16 bcdDevice;
+	u16 version;			/* bcdUSB */
+	u32 speed;			/* in kbit/s, 0 if unknown */
+	u32 quirks;
+	u16 bMaxPower;			/* in mA */
+	u8 maxchild;
+	u32 loaded;			/* see load_usb_device() */
 
-	char *idProduct;
-	char *idVendor;
-	char *busnum;
-	char *devnum;
-	char *maxchild;
-	char *quirks;
-	char *speed;
-	char *version;
+	u8 bConfigurationValue;
+	u8 bDeviceClass;
+	u8 bDeviceProtocol;
+	u8 bDeviceSubClass;
+	u8 bNumConfigurations;
+	u8 bNumInterfaces;
+	u8 bmAttributes;
+	u8 bMaxPacketSize0;
 
-	char *bConfigurationValue;
-	char *bDeviceClass;
-	char *bDeviceProtocol;
-	char *bDeviceSubClass;
-	char *bNumConfigurations;
-	char *bNumInterfaces;
-	char *bmAttributes;
-	char *bMaxPacketSize0;
-	char *bMaxPower;
 	char *manufacturer;
-	char *bcdDevice;
 	char *product;
 	char *serial;
+	char *sysname;
 
 	struct usb_endpoint *ep0;
 	struct usb_device_qualifier *qualifier;
 	char *name;
 	char *driver;			/* always "usb" but hey, it's nice to be complete */
+	unsigned char *descriptors;	/* the raw "descriptors" file, for -v */
+	u32 descriptors_size;
 };
 
 #endif	/* #define _USB_H */
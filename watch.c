@@ -0,0 +1,314 @@
+/*
+ * watch.c
+ *
+ * Keep the list of devices up to date as things are plugged in and pulled
+ * out, and say what happened.
+ *
+ * Copyright (C) 2009 Greg Kroah-Hartman <greg@kroah.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+
+#include "list.h"
+#include "usb.h"
+#include "lsusb.h"
+#include "arena.h"
+
+
+
+/*
+ * The monitor is started before the initial scan, so nothing that happens
+ * while the scan runs is missed.  Events for things the scan already saw are
+ * sorted out below.
+ */
+static int monitor_fd = -1;
+static FILE *events;		/* where to say what happened, if anywhere */
+
+int watch_begin(FILE *file)
+{
+	events = file;
+	monitor_fd = sysfs_monitor_begin();
+	return monitor_fd;
+}
+
+static unsigned long usec_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000UL +
+	       (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void print_device_event(const char *action, struct usb_device *usb_device,
+			       unsigned long usec)
+{
+	struct usb_interface *usb_interface;
+	const char *vendor;
+	const char *product;
+
+	if (events == NULL)
+		return;
+	usb_device_names(usb_device, &vendor, &product);
+	fprintf(events, "%s Bus %03u Device %03u: ID %04x:%04x %s%s%s [%luus]\n",
+		action,
+		usb_device->busnum,
+		usb_device->devnum,
+		usb_device->idVendor,
+		usb_device->idProduct,
+		vendor,
+		product ? " " : "",
+		product ? product : "",
+		usec);
+	if (strcmp(action, "add") != 0)
+		return;
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+		fprintf(events, "%s\tIntf %s (%s)\n", action,
+			usb_interface->sysname,
+			usb_interface->driver);
+}
+
+static void print_interface_event(const char *action,
+				  struct usb_interface *usb_interface,
+				  unsigned long usec)
+{
+	if (events == NULL)
+		return;
+	fprintf(events, "%s\tIntf %s (%s) [%luus]\n", action,
+		usb_interface->sysname,
+		usb_interface->driver,
+		usec);
+}
+
+/*
+ * Interfaces live on the device they belong to: "2-1.4:1.0" is on "2-1.4",
+ * and the interfaces of root hub "usb2" are "2-0:1.0" and so on.
+ */
+static struct usb_device *interface_usb_device(const char *sysname)
+{
+	char name[64];
+	const char *colon;
+	size_t len;
+
+	colon = strchr(sysname, ':');
+	if (colon == NULL)
+		return NULL;
+	len = colon - sysname;
+	if (len >= sizeof(name) - 3)
+		return NULL;
+	if (len > 2 && strncmp(colon - 2, "-0", 2) == 0)
+		snprintf(name, sizeof(name), "usb%.*s", (int)(len - 2), sysname);
+	else
+		snprintf(name, sizeof(name), "%.*s", (int)len, sysname);
+	return find_usb_device(&usb_devices, name);
+}
+
+static struct usb_interface *find_usb_interface(struct usb_device *usb_device,
+						const char *sysname)
+{
+	struct usb_interface *usb_interface;
+
+	list_for_each_entry(usb_interface, &usb_device->interfaces, list)
+		if (usb_interface->sysname && strcmp(usb_interface->sysname, sysname) == 0)
+			return usb_interface;
+	return NULL;
+}
+
+/*
+ * Point driver at what is bound now.  Driver names are interned, so a device
+ * that keeps getting bound and unbound doesn't use up any more memory.
+ */
+static void update_driver(struct sysfs_dev *dev, char **driver)
+{
+	char name[NAME_MAX];
+	const char *temp;
+
+	temp = get_dev_driver(dev, name, sizeof(name));
+	*driver = temp ? robust_intern(temp) : NULL;
+}
+
+static void device_event(struct sysfs_dev *dev, const char *action,
+			 const struct timespec *start)
+{
+	struct usb_device *usb_device;
+	struct arena *arena;
+	struct arena *old;
+
+	usb_device = find_usb_device(&usb_devices, get_dev_sysname(dev));
+
+	if (strcmp(action, "add") == 0) {
+		/* we missed the remove, or the scan already picked it up */
+		if (usb_device)
+			remove_usb_device(&usb_devices, usb_device);
+		arena = calloc(1, sizeof(*arena));
+		if (arena == NULL)
+			exit(1);
+		old = use_arena(arena);
+		usb_device = create_usb_device(dev, NULL);
+		use_arena(old);
+		if (usb_device == NULL) {
+			arena_release(arena);
+			free(arena);
+			return;
+		}
+		usb_device->arena = arena;
+		add_usb_device(&usb_devices, usb_device);
+		print_device_event(action, usb_device, usec_since(start));
+		return;
+	}
+
+	if (usb_device == NULL)
+		return;
+	if (strcmp(action, "remove") == 0) {
+		/* print it first, all of it is gone after the remove */
+		print_device_event(action, usb_device, usec_since(start));
+		remove_usb_device(&usb_devices, usb_device);
+	} else if (strcmp(action, "bind") == 0 || strcmp(action, "unbind") == 0) {
+		update_driver(dev, &usb_device->driver);
+		print_device_event(action, usb_device, usec_since(start));
+	}
+}
+
+static void interface_event(struct sysfs_dev *dev, const char *action,
+			    const struct timespec *start)
+{
+	struct usb_interface *usb_interface;
+	struct usb_device *usb_device;
+	const char *sysname = get_dev_sysname(dev);
+	struct arena *arena;
+	struct arena *old;
+
+	usb_device = interface_usb_device(sysname);
+	if (usb_device == NULL)
+		return;
+	usb_interface = find_usb_interface(usb_device, sysname);
+
+	if (strcmp(action, "add") == 0) {
+		/* found when the device was read, nothing new to say */
+		if (usb_interface)
+			return;
+		/* its own arena, as it may well go again before the device */
+		arena = calloc(1, sizeof(*arena));
+		if (arena == NULL)
+			exit(1);
+		old = use_arena(arena);
+		usb_interface = build_usb_interface(dev, usb_device);
+		use_arena(old);
+		usb_interface->arena = arena;
+		print_interface_event(action, usb_interface, usec_since(start));
+		return;
+	}
+
+	if (usb_interface == NULL)
+		return;
+	if (strcmp(action, "remove") == 0) {
+		/* print it first, all of it is gone after the remove */
+		print_interface_event(action, usb_interface, usec_since(start));
+		remove_usb_interface(usb_interface);
+	} else if (strcmp(action, "bind") == 0 || strcmp(action, "unbind") == 0) {
+		update_driver(dev, &usb_interface->driver);
+		print_interface_event(action, usb_interface, usec_since(start));
+	}
+}
+
+/*
+ * Events were lost (see sysfs_monitor_begin()), and there is no telling
+ * which, so the list is thrown away and read in again from scratch.  The
+ * old one is only dropped once the devices can be listed.
+ */
+static void watch_rescan(const struct timespec *start)
+{
+	struct usb_device *usb_device;
+	struct sysfs_scan scan;
+	struct sysfs_dev dev;
+	struct arena *old;
+	unsigned int count = 0;
+	unsigned int i;
+
+	if (sysfs_scan_begin(&scan)) {
+		fprintf(stderr, "lost usb events, and can't read the usb devices in %s again\n",
+			sysfs_root);
+		return;
+	}
+	free_usb_devices(&usb_devices);
+	old = use_arena(usb_devices.arena);
+	for (i = 0; i < scan.count; i++) {
+		if (sysfs_scan_open(&scan, i, &dev))
+			continue;
+		usb_device = create_usb_device(&dev, NULL);
+		close_dev(&dev);
+		if (usb_device == NULL)
+			continue;
+		add_usb_device(&usb_devices, usb_device);
+		count++;
+	}
+	use_arena(old);
+	sysfs_scan_end(&scan);
+
+	fprintf(events ? events : stderr,
+		"rescan %u devices, usb events were lost [%luus]\n",
+		count, usec_since(start));
+}
+
+/*
+ * Handle one event.  Each one only touches the device it is about (found
+ * through the hash), so it costs the same no matter how many other devices
+ * there are.  The time each took to handle, from the monitor waking us up to
+ * the list being updated, goes on the end of the line.
+ */
+void watch_event(void)
+{
+	struct sysfs_event event;
+	struct timespec start;
+	struct sysfs_dev dev;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (sysfs_monitor_receive(&dev, &event)) {
+		if (errno == ENOBUFS)
+			watch_rescan(&start);
+		if (events)
+			fflush(events);
+		return;
+	}
+	if (strcmp(event.devtype, "usb_device") == 0)
+		device_event(&dev, event.action, &start);
+	else if (strcmp(event.devtype, "usb_interface") == 0)
+		interface_event(&dev, event.action, &start);
+	close_dev(&dev);
+	if (events)
+		fflush(events);
+}
+
+/* Handle events until we get killed */
+void watch_usb_devices(void)
+{
+	struct pollfd pfd;
+
+	pfd.fd = monitor_fd;
+	pfd.events = POLLIN;
+	fflush(stdout);
+
+	while (1) {
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		watch_event();
+	}
+	sysfs_monitor_end();
+}